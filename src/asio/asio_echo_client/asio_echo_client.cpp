@@ -7,10 +7,11 @@
 #include <boost/program_options.hpp>
 
 #include "common.h"
-#include "test_pingpong_client.hpp"
-#include "test_latency_client.hpp"
-#include "test_qps_client.hpp"
+#include "test_client.hpp"
 #include "common/cmd_utils.hpp"
+#include "common/echo_frame.hpp"
+#include "common/echo_payload.hpp"
+#include "common/process_stats.hpp"
 
 uint32_t g_test_mode      = asio_test::test_mode_echo;
 uint32_t g_test_method    = asio_test::test_method_pingpong;
@@ -24,99 +25,26 @@ std::string g_server_port;
 using namespace boost::asio;
 using namespace asio_test;
 
-void run_pingpong_client(const std::string & app_name, const std::string & ip,
-    const std::string & port, uint32_t packet_size, uint32_t test_time)
+void run_test_client(const std::string & app_name, const client_config & config)
 {
     std::cout << std::endl;
-    std::cout << app_name.c_str() << " [mode = " << g_test_mode_str.c_str() << "]" << std::endl;
+    std::cout << app_name.c_str() << " [mode = " << g_test_mode_str.c_str()
+              << ", test = " << g_test_method_str.c_str() << "]" << std::endl;
     std::cout << std::endl;
     try {
-        boost::asio::io_service io_service;
+        test_client client(config);
 
-        ip::tcp::resolver resolver(io_service);
-        auto endpoint_iterator = resolver.resolve( { ip, port } );
-        test_pingpong_client client(io_service, endpoint_iterator, packet_size);
-
-        std::cout << "connectting " << ip.c_str() << ":" << port.c_str() << std::endl;
-        std::cout << "packet_size: " << packet_size << std::endl;
-        std::cout << std::endl;
-
-        io_service.run();
-    }
-    catch (const std::exception & e) {
-        std::cerr << "Exception: " << e.what() << std::endl;
-    }
-    std::cout << app_name.c_str() << " done." << std::endl;
-}
-
-void run_qps_client(const std::string & app_name, const std::string & ip,
-    const std::string & port, uint32_t packet_size, uint32_t test_time)
-{
-    std::cout << std::endl;
-    std::cout << app_name.c_str() << " [mode = " << g_test_mode_str.c_str() << "]" << std::endl;
-    std::cout << std::endl;
-    try {
-        boost::asio::io_service io_service;
-
-        ip::tcp::resolver resolver(io_service);
-        auto endpoint_iterator = resolver.resolve( { ip, port } );
-        test_qps_client client(io_service, endpoint_iterator, g_test_mode, 32768, packet_size);
-
-        std::cout << "connectting " << ip.c_str() << ":" << port.c_str() << std::endl;
-        std::cout << "packet_size: " << packet_size << std::endl;
-        std::cout << std::endl;
-
-        io_service.run();
-    }
-    catch (const std::exception & e) {
-        std::cerr << "Exception: " << e.what() << std::endl;
-    }
-    std::cout << app_name.c_str() << " done." << std::endl;
-}
-
-void run_throughput_client(const std::string & app_name, const std::string & ip,
-    const std::string & port, uint32_t packet_size, uint32_t test_time)
-{
-    std::cout << std::endl;
-    std::cout << app_name.c_str() << " [mode = " << g_test_mode_str.c_str() << "]" << std::endl;
-    std::cout << std::endl;
-    try {
-        boost::asio::io_service io_service;
-
-        ip::tcp::resolver resolver(io_service);
-        auto endpoint_iterator = resolver.resolve( { ip, port } );
-        test_qps_client client(io_service, endpoint_iterator, g_test_mode, 32768, packet_size);
-
-        std::cout << "connectting " << ip.c_str() << ":" << port.c_str() << std::endl;
-        std::cout << "packet_size: " << packet_size << std::endl;
+        std::cout << "connectting " << config.ip.c_str() << ":" << config.port.c_str() << std::endl;
+        std::cout << "packet_size: " << config.packet_size << ", thread_num: " << config.thread_num
+                  << ", conn_num: " << config.conn_num << ", pipeline: " << config.pipeline << std::endl;
         std::cout << std::endl;
 
-        io_service.run();
-    }
-    catch (const std::exception & e) {
-        std::cerr << "Exception: " << e.what() << std::endl;
-    }
-    std::cout << app_name.c_str() << " done." << std::endl;
-}
-
-void run_latency_client(const std::string & app_name, const std::string & ip,
-    const std::string & port, uint32_t packet_size, uint32_t test_time)
-{
-    std::cout << std::endl;
-    std::cout << app_name.c_str() << " [mode = " << g_test_mode_str.c_str() << "]" << std::endl;
-    std::cout << std::endl;
-    try {
-        boost::asio::io_service io_service;
-
-        ip::tcp::resolver resolver(io_service);
-        auto endpoint_iterator = resolver.resolve( { ip, port } );
-        test_latency_client client(io_service, endpoint_iterator, packet_size);
-
-        std::cout << "connectting " << ip.c_str() << ":" << port.c_str() << std::endl;
-        std::cout << "packet_size: " << packet_size << std::endl;
+        std::cout << "warm_up_time: " << config.warm_up_time << " s, test_time: " << config.test_time
+                  << " s, cool_down_time: " << config.cool_down_time << " s" << std::endl;
         std::cout << std::endl;
 
-        io_service.run();
+        client.start();
+        client.run();
     }
     catch (const std::exception & e) {
         std::cerr << "Exception: " << e.what() << std::endl;
@@ -141,13 +69,25 @@ void print_usage(const std::string & app_name, const boost::program_options::opt
 
     std::cerr << "Usage: " << std::endl << std::endl
               << "  " << app_name.c_str()      << " --host=<host> --port=<port> --mode=<mode> --test=<test>" << std::endl
-              << "  " << leader_spaces.c_str() << " --pipeline=<pipeline> [--packet_size=64] [--thread-num=0]" << std::endl
+              << "  " << leader_spaces.c_str() << " --pipeline=<pipeline> [--packet_size=64] [--thread-num=0] [--conn-num=1]" << std::endl
+              << "  " << leader_spaces.c_str() << " [--warm-up=0] [--test-time=30] [--cool-down=0] [--report=<file.json|file.csv>]" << std::endl
+              << "  " << leader_spaces.c_str() << " [--rate=0] [--arrival=constant]" << std::endl
+              << "  " << leader_spaces.c_str() << " [--heartbeat=1000] [--source-ips=0] [--requests-per-conn=1]" << std::endl
               << std::endl
               << "For example: " << std::endl << std::endl
               << "  " << app_name.c_str()      << " --host=127.0.0.1 --port=9000 --mode=echo --test=pingpong" << std::endl
-              << "  " << leader_spaces.c_str() << " --pipeline=10 --packet-size=64 --thread-num=8" << std::endl
+              << "  " << leader_spaces.c_str() << " --pipeline=10 --packet-size=64 --thread-num=8 --conn-num=64" << std::endl
+              << "  " << leader_spaces.c_str() << " --warm-up=5 --test-time=30 --cool-down=2 --report=result.json" << std::endl
               << std::endl
-              << "  " << app_name.c_str() << " -s 127.0.0.1 -p 9000 -m echo -t pingpong -l 10 -k 64 -n 8" << std::endl;
+              << "  " << app_name.c_str() << " -s 127.0.0.1 -p 9000 -m echo -t pingpong -l 10 -k 64 -n 8 -c 64 -w 5 -i 30 -d 2 -r result.json" << std::endl
+              << std::endl
+              << "  " << app_name.c_str()      << " --host=127.0.0.1 --port=9000 --test=idle --conn-num=500000" << std::endl
+              << "  " << leader_spaces.c_str() << " --heartbeat=10000 --source-ips=32 --thread-num=4 --warm-up=60" << std::endl
+              << std::endl
+              << "  " << app_name.c_str()      << " --host=127.0.0.1 --port=9000 --test=churn --conn-num=64" << std::endl
+              << "  " << leader_spaces.c_str() << " --requests-per-conn=1 --source-ips=8 --thread-num=4" << std::endl
+              << std::endl
+              << "  " << app_name.c_str() << " -s 127.0.0.1 -p 9000 -t latency -c 16 -n 4 -q 50000 -a poisson -l 64" << std::endl;
     std::cerr << std::endl;
 }
 
@@ -157,7 +97,11 @@ int main(int argc, char * argv[])
     std::string test_mode, test_method, rpc_topic;
     std::string server_ip, server_port;
     std::string mode, test, cmd, cmd_value;
-    int32_t pipeline = 1, packet_size = 0, thread_num = 0, test_time = 30, need_echo = 1;
+    std::string latency_file, report_file, report_format, arrival, protocol;
+    double rate = 0.0;
+    int32_t pipeline = 1, packet_size = 0, max_packet_size = 0, thread_num = 0, conn_num = 1, need_echo = 1, payload_header = 0;
+    int32_t warm_up_time = 0, test_time = 30, cool_down_time = 0, busy_poll = 0;
+    int32_t heartbeat_interval = 1000, source_ips = 0, requests_per_conn = 1;
 
     namespace options = boost::program_options;
     options::options_description desc("Command list");
@@ -166,12 +110,27 @@ int main(int argc, char * argv[])
         ("host,s",          options::value<std::string>(&server_ip)->default_value("127.0.0.1"),        "server host or ip address")
         ("port,p",          options::value<std::string>(&server_port)->default_value("9000"),           "server port")
         ("mode,m",          options::value<std::string>(&test_mode)->default_value("echo"),             "test mode = [echo]")
-        ("test,t",          options::value<std::string>(&test_method)->default_value("pingpong"),       "test method = [pingpong, qps, latency, throughput]")
-        ("pipeline,l",      options::value<int32_t>(&pipeline)->default_value(1),                       "pipeline numbers")
+        ("test,t",          options::value<std::string>(&test_method)->default_value("pingpong"),       "test method = [pingpong, qps, latency, throughput, idle, churn], idle = mostly idle connections with heartbeats, churn = connect, request and close in a loop")
+        ("pipeline,l",      options::value<int32_t>(&pipeline)->default_value(1),                       "requests in flight per connection")
         ("packet-size,k",   options::value<int32_t>(&packet_size)->default_value(64),                   "packet size")
+        ("packet-size-max,x", options::value<int32_t>(&max_packet_size)->default_value(0),              "max frame size of the mixed sizes in [packet-size, packet-size-max], only for the framed protocol")
+        ("protocol,o",      options::value<std::string>(&protocol)->default_value("raw"),               "echo protocol = [raw, framed], framed = length-prefixed frames (see echo_frame.hpp)")
         ("thread-num,n",    options::value<int32_t>(&thread_num)->default_value(1),                     "thread numbers")
-        ("test-time,i",     options::value<int32_t>(&test_time)->default_value(30),                     "total test time (seconds)")
+        ("conn-num,c",      options::value<int32_t>(&conn_num)->default_value(1),                       "connection numbers, spread over the threads")
+        ("rate,q",          options::value<double>(&rate)->default_value(0.0),                          "open-loop target rate of all connections (requests/sec), 0 = closed-loop")
+        ("arrival,a",       options::value<std::string>(&arrival)->default_value("constant"),           "open-loop arrival = [constant, poisson]")
+        ("warm-up,w",       options::value<int32_t>(&warm_up_time)->default_value(0),                   "warm-up time before the measurement (seconds)")
+        ("test-time,i",     options::value<int32_t>(&test_time)->default_value(30),                     "measurement time (seconds)")
+        ("cool-down,d",     options::value<int32_t>(&cool_down_time)->default_value(0),                 "cool-down time after the measurement (seconds)")
         ("echo,e",          options::value<int32_t>(&need_echo)->default_value(1),                      "whether the server need echo")
+        ("busy-poll,b",     options::value<int32_t>(&busy_poll)->default_value(0),                      "microseconds the io_service threads spin on poll() before blocking, 0 = block in run()")
+        ("payload-header,g", options::value<int32_t>(&payload_header)->default_value(0),                "carry a header (sequence, timestamp, checksum) in every packet and verify the echoes")
+        ("latency-file,f",  options::value<std::string>(&latency_file)->default_value(""),              "export the latency percentile distribution of the measurement to the file")
+        ("report,r",        options::value<std::string>(&report_file)->default_value(""),               "write the final report of the measurement to the file")
+        ("report-format",   options::value<std::string>(&report_format)->default_value(""),             "report format = [json, csv], default is chosen by the file extension")
+        ("heartbeat",       options::value<int32_t>(&heartbeat_interval)->default_value(1000),          "heartbeat interval of the idle test (milliseconds)")
+        ("source-ips",      options::value<int32_t>(&source_ips)->default_value(0),                     "bind the connections of the idle and churn tests to N loopback source ips from 127.0.0.1, 0 = not bound")
+        ("requests-per-conn", options::value<int32_t>(&requests_per_conn)->default_value(1),            "pingpong requests of every connection of the churn test before it is closed")
         ;
 
     // parse command line
@@ -251,6 +210,12 @@ int main(int argc, char * argv[])
     else if (test_method == "latency") {
         g_test_method = test_method_latency;
     }
+    else if (test_method == "idle") {
+        g_test_method = test_method_idle;
+    }
+    else if (test_method == "churn") {
+        g_test_method = test_method_churn;
+    }
     else {
         // Write error log: Unknown test method
         std::cerr << "Error: Unknown test method: [" << test.c_str() << "]." << std::endl;
@@ -278,6 +243,43 @@ int main(int argc, char * argv[])
                   << MAX_PACKET_SIZE << " bytes [MAX_PACKET_SIZE]." << std::endl;
     }
 
+    // protocol
+    if (args_map.count("protocol") > 0) {
+        protocol = args_map["protocol"].as<std::string>();
+    }
+    std::cout << "protocol: " << protocol.c_str() << std::endl;
+    uint32_t protocol_type = protocol_raw;
+    if (protocol == "framed") {
+        protocol_type = protocol_framed;
+    }
+    else if (protocol != "raw") {
+        std::cerr << "Error: Unknown protocol: [" << protocol.c_str() << "]." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if (protocol_type == protocol_framed && packet_size < (int32_t)echo_frame::kHeaderSize) {
+        packet_size = echo_frame::kHeaderSize;
+        std::cerr << "Warnning: packet_size = " << packet_size << " can not set to less than the frame header "
+                  << echo_frame::kHeaderSize << " bytes of the framed protocol." << std::endl;
+    }
+
+    // packet-size-max
+    if (args_map.count("packet-size-max") > 0) {
+        max_packet_size = args_map["packet-size-max"].as<int32_t>();
+    }
+    if (max_packet_size > MAX_PACKET_SIZE)
+        max_packet_size = MAX_PACKET_SIZE;
+    // It is never less than packet_size, so the frame header also fits the mixed sizes.
+    if (max_packet_size <= packet_size) {
+        max_packet_size = packet_size;
+    }
+    else if (protocol_type != protocol_framed) {
+        std::cerr << "Warnning: packet-size-max needs the framed protocol, use the fixed packet size." << std::endl;
+        max_packet_size = packet_size;
+    }
+    else {
+        std::cout << "packet-size-max: " << max_packet_size << std::endl;
+    }
+
     // thread-num
     if (args_map.count("thread-num") > 0) {
         thread_num = args_map["thread-num"].as<int32_t>();
@@ -288,6 +290,18 @@ int main(int argc, char * argv[])
         std::cout << ">>> thread-num: std::thread::hardware_concurrency() = " << thread_num << std::endl;
     }
 
+    // conn-num
+    if (args_map.count("conn-num") > 0) {
+        conn_num = args_map["conn-num"].as<int32_t>();
+    }
+    std::cout << "conn-num: " << conn_num << std::endl;
+    if (conn_num <= 0)
+        conn_num = 1;
+    if (conn_num < thread_num) {
+        thread_num = conn_num;
+        std::cout << ">>> thread-num: no more than conn-num = " << thread_num << std::endl;
+    }
+
     // test-time
     if (args_map.count("test-time") > 0) {
         test_time = args_map["test-time"].as<int32_t>();
@@ -298,25 +312,173 @@ int main(int argc, char * argv[])
         std::cout << ">>> test-time: " << test_time << std::endl;
     }
 
+    // rate
+    if (args_map.count("rate") > 0) {
+        rate = args_map["rate"].as<double>();
+    }
+    if (rate < 0.0)
+        rate = 0.0;
+    if (rate > 0.0 && g_test_method == test_method_throughput) {
+        std::cerr << "Warnning: rate is ignored by the throughput test." << std::endl;
+        rate = 0.0;
+    }
+    if (rate > 0.0)
+        std::cout << "rate: " << rate << std::endl;
+
+    // arrival
+    if (args_map.count("arrival") > 0) {
+        arrival = args_map["arrival"].as<std::string>();
+    }
+    uint32_t arrival_type = arrival_constant;
+    if (arrival == "poisson") {
+        arrival_type = arrival_poisson;
+    }
+    else if (arrival != "constant") {
+        std::cerr << "Error: Unknown arrival: [" << arrival.c_str() << "]." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if (rate > 0.0)
+        std::cout << "arrival: " << arrival.c_str() << std::endl;
+
+    // warm-up
+    if (args_map.count("warm-up") > 0) {
+        warm_up_time = args_map["warm-up"].as<int32_t>();
+    }
+    std::cout << "warm-up: " << warm_up_time << std::endl;
+    if (warm_up_time < 0)
+        warm_up_time = 0;
+
+    // cool-down
+    if (args_map.count("cool-down") > 0) {
+        cool_down_time = args_map["cool-down"].as<int32_t>();
+    }
+    std::cout << "cool-down: " << cool_down_time << std::endl;
+    if (cool_down_time < 0)
+        cool_down_time = 0;
+
     // need_echo
     if (args_map.count("echo") > 0) {
         need_echo = args_map["echo"].as<int32_t>();
     }
     std::cout << "need_echo: " << need_echo << std::endl;
 
-    // Run a test method
-    if (g_test_method == test_method_pingpong)
-        run_pingpong_client(app_name, server_ip, server_port, packet_size, test_time);
-    else if (g_test_method == test_method_qps)
-        run_qps_client(app_name, server_ip, server_port, packet_size, test_time);
-    else if (g_test_method == test_method_throughput)
-        run_throughput_client(app_name, server_ip, server_port, packet_size, test_time);
-    else if (g_test_method == test_method_latency)
-        run_latency_client(app_name, server_ip, server_port, packet_size, test_time);
-    else {
-        // Write error log.
-        std::cerr << "Error: Unknown test method: [" << g_test_method << "]." << std::endl;
+    // payload-header
+    if (args_map.count("payload-header") > 0) {
+        payload_header = args_map["payload-header"].as<int32_t>();
+    }
+    std::cout << "payload-header: " << payload_header << std::endl;
+    if (payload_header != 0 && g_test_method == test_method_throughput) {
+        std::cerr << "Warnning: payload-header is ignored by the throughput test." << std::endl;
+        payload_header = 0;
+    }
+    if (payload_header != 0) {
+        // Every packet (the payload of a frame) must hold the whole payload header.
+        int32_t min_packet_size = (int32_t)echo_payload::kHeaderSize;
+        if (protocol_type == protocol_framed)
+            min_packet_size += (int32_t)echo_frame::kHeaderSize;
+        if (packet_size < min_packet_size) {
+            packet_size = min_packet_size;
+            std::cerr << "Warnning: packet_size = " << packet_size << " can not set to less than the headers "
+                      << min_packet_size << " bytes [payload-header]." << std::endl;
+        }
+        if (max_packet_size < packet_size)
+            max_packet_size = packet_size;
+    }
+
+    // busy-poll
+    if (args_map.count("busy-poll") > 0) {
+        busy_poll = args_map["busy-poll"].as<int32_t>();
+    }
+    if (busy_poll < 0)
+        busy_poll = 0;
+    std::cout << "busy-poll: " << busy_poll << " us" << std::endl;
+
+    // heartbeat
+    if (args_map.count("heartbeat") > 0) {
+        heartbeat_interval = args_map["heartbeat"].as<int32_t>();
+    }
+    if (heartbeat_interval <= 0)
+        heartbeat_interval = 1000;
+
+    // source-ips
+    if (args_map.count("source-ips") > 0) {
+        source_ips = args_map["source-ips"].as<int32_t>();
+    }
+    if (source_ips < 0)
+        source_ips = 0;
+    if (source_ips > 0 && server_ip.compare(0, 4, "127.") != 0) {
+        std::cerr << "Warnning: source-ips is only for the loopback, the connections are not bound." << std::endl;
+        source_ips = 0;
+    }
+
+    // requests-per-conn
+    if (args_map.count("requests-per-conn") > 0) {
+        requests_per_conn = args_map["requests-per-conn"].as<int32_t>();
+    }
+    if (requests_per_conn < 0)
+        requests_per_conn = 0;
+    if (g_test_method == test_method_churn) {
+        std::cout << "requests-per-conn: " << requests_per_conn << ", source-ips: " << source_ips << std::endl;
+    }
+
+    if (g_test_method == test_method_idle) {
+        std::cout << "heartbeat: " << heartbeat_interval << " ms, source-ips: " << source_ips << std::endl;
+
+        // Every connection needs a file descriptor.
+        uint64_t open_files_limit = process_stats::raise_open_files_limit();
+        if (open_files_limit != 0 && open_files_limit < (uint64_t)conn_num + 64) {
+            std::cerr << "Warnning: the open files limit " << open_files_limit << " is less than the conn-num "
+                      << conn_num << ", raise the hard limit (ulimit -Hn)." << std::endl;
+        }
+    }
+
+    // latency-file
+    if (args_map.count("latency-file") > 0) {
+        latency_file = args_map["latency-file"].as<std::string>();
+    }
+    if (!latency_file.empty())
+        std::cout << "latency-file: " << latency_file.c_str() << std::endl;
+
+    // report
+    if (args_map.count("report") > 0) {
+        report_file = args_map["report"].as<std::string>();
+    }
+    if (args_map.count("report-format") > 0) {
+        report_format = args_map["report-format"].as<std::string>();
+    }
+    if (!report_format.empty() && report_format != "json" && report_format != "csv") {
+        std::cerr << "Error: Unknown report format: [" << report_format.c_str() << "]." << std::endl;
+        exit(EXIT_FAILURE);
     }
+    if (!report_file.empty())
+        std::cout << "report: " << report_file.c_str() << std::endl;
+
+    // Run the test client
+    client_config config;
+    config.ip               = server_ip;
+    config.port             = server_port;
+    config.method           = g_test_method;
+    config.packet_size      = (uint32_t)packet_size;
+    config.max_packet_size  = (uint32_t)max_packet_size;
+    config.protocol         = protocol_type;
+    config.thread_num       = (uint32_t)thread_num;
+    config.conn_num         = (uint32_t)conn_num;
+    config.pipeline         = (uint32_t)pipeline;
+    config.latency_file     = latency_file;
+    config.rate             = rate;
+    config.arrival          = arrival_type;
+    config.payload_header   = (payload_header != 0);
+    config.busy_poll        = (uint32_t)busy_poll;
+    config.heartbeat_interval = (uint32_t)heartbeat_interval;
+    config.source_ips       = (uint32_t)source_ips;
+    config.requests_per_conn = (uint32_t)requests_per_conn;
+    config.warm_up_time     = (uint32_t)warm_up_time;
+    config.test_time        = (uint32_t)test_time;
+    config.cool_down_time   = (uint32_t)cool_down_time;
+    config.report_file      = report_file;
+    config.report_format    = report_format;
+
+    run_test_client(app_name, config);
 
 #ifdef _WIN32
     ::system("pause");
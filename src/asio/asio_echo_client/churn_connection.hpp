@@ -0,0 +1,205 @@
+#pragma once
+
+#include <stdint.h>
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "common.h"
+#include "client_config.hpp"
+#include "client_stats.hpp"
+#include "socket_utils.hpp"
+#include "common/echo_frame.hpp"
+
+using namespace boost::asio;
+using namespace std::chrono;
+
+namespace asio_test {
+
+//
+// One connection slot of the churn test: it connects, sends requests_per_conn pingpong
+// requests (0 is none), closes the connection and connects again, as fast as the server
+// accepts. So the test measures the rate of the connection setup and teardown, and the connect
+// latency (from the connect() call to its completion) besides the request latency.
+//
+// The client closes first, so the TIME_WAIT sockets are left on the client side, the
+// loopback reuses them for the new connects (net.ipv4.tcp_tw_reuse). With a source
+// address, the socket is bound to it before every connect (see bind_source_address()).
+//
+// A failed connect is retried after kRetryDelay, so a refused or overloaded server
+// isn't flooded by the failures.
+//
+class churn_connection : private boost::noncopyable {
+public:
+    typedef std::chrono::steady_clock   clock_type;
+    typedef clock_type::time_point      time_point_type;
+
+    static const uint32_t kRetryDelay = 100;    // milliseconds
+
+private:
+    ip::tcp::socket socket_;
+    boost::asio::steady_timer retry_timer_;
+    client_stats &  stats_;
+    std::size_t     thread_index_;
+    ip::tcp::endpoint endpoint_;
+    ip::address     source_address_;
+    uint32_t        requests_per_conn_;
+    uint32_t        request_count_;
+    time_point_type connect_time_;
+    time_point_type send_time_;
+    bool            connected_;
+    bool            stopped_;
+    std::vector<char> buffer_;
+
+public:
+    churn_connection(boost::asio::io_service & io_service, client_stats & stats,
+                     const client_config & config, std::size_t thread_index)
+        : socket_(io_service), retry_timer_(io_service), stats_(stats), thread_index_(thread_index),
+          requests_per_conn_(config.requests_per_conn), request_count_(0),
+          connected_(false), stopped_(false), buffer_(config.packet_size, 'k')
+    {
+        if (config.protocol == protocol_framed) {
+            echo_frame::write_header(buffer_.data(), config.packet_size - echo_frame::kHeaderSize,
+                                     echo_frame::frame_type_echo);
+        }
+    }
+
+    ~churn_connection()
+    {
+        boost::system::error_code ec;
+        if (socket_.is_open())
+            socket_.close(ec);
+    }
+
+    void start(const ip::tcp::endpoint & endpoint, const ip::address & source_address)
+    {
+        endpoint_ = endpoint;
+        source_address_ = source_address;
+        do_connect();
+    }
+
+    void stop()
+    {
+        stopped_ = true;
+        boost::system::error_code ec;
+        retry_timer_.cancel(ec);
+        do_close();
+    }
+
+private:
+    void handle_error(const char * where, const boost::system::error_code & ec)
+    {
+        do_close();
+        if (stopped_ || ec == boost::asio::error::operation_aborted)
+            return;
+
+        std::cout << "churn_connection::" << where << "() - Error: (code = " << ec.value() << ") "
+                  << ec.message().c_str() << std::endl;
+        stats_.add_error();
+
+        retry_timer_.expires_from_now(std::chrono::milliseconds(kRetryDelay));
+        retry_timer_.async_wait(
+            [this](const boost::system::error_code & ec)
+            {
+                if (!ec && !stopped_)
+                    do_connect();
+            });
+    }
+
+    void do_close()
+    {
+        boost::system::error_code ec;
+        if (socket_.is_open()) {
+            socket_.shutdown(socket_base::shutdown_both, ec);
+            socket_.close(ec);
+        }
+        if (connected_) {
+            connected_ = false;
+            stats_.remove_connection();
+        }
+    }
+
+    /// Close this connection and open the next one.
+    void do_reconnect()
+    {
+        do_close();
+        if (!stopped_)
+            do_connect();
+    }
+
+    void do_connect()
+    {
+        connect_time_ = clock_type::now();
+
+        boost::system::error_code ec;
+        bind_source_address(socket_, endpoint_, source_address_, ec);
+        if (ec) {
+            handle_error("do_connect", ec);
+            return;
+        }
+
+        socket_.async_connect(endpoint_,
+            [this](const boost::system::error_code & ec)
+            {
+                if (!ec) {
+                    connected_ = true;
+                    stats_.add_connection();
+                    stats_.record_connect(thread_index_,
+                        (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - connect_time_).count());
+
+                    socket_.set_option(ip::tcp::no_delay(true));
+                    request_count_ = 0;
+                    if (requests_per_conn_ > 0)
+                        do_request();
+                    else
+                        do_reconnect();
+                }
+                else {
+                    handle_error("do_connect", ec);
+                }
+            });
+    }
+
+    void do_request()
+    {
+        send_time_ = clock_type::now();
+        boost::asio::async_write(socket_, boost::asio::buffer(buffer_),
+            [this](const boost::system::error_code & ec, std::size_t send_bytes)
+            {
+                if (!ec) {
+                    stats_.add_send_bytes(send_bytes);
+                    do_read_echo();
+                }
+                else {
+                    handle_error("do_request", ec);
+                }
+            });
+    }
+
+    void do_read_echo()
+    {
+        boost::asio::async_read(socket_, boost::asio::buffer(buffer_),
+            [this](const boost::system::error_code & ec, std::size_t recv_bytes)
+            {
+                if (!ec) {
+                    stats_.add_recv_bytes(recv_bytes);
+                    stats_.record_latency(thread_index_,
+                        (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now() - send_time_).count());
+                    stats_.add_query(1);
+
+                    if (++request_count_ < requests_per_conn_)
+                        do_request();
+                    else
+                        do_reconnect();
+                }
+                else {
+                    handle_error("do_read_echo", ec);
+                }
+            });
+    }
+};
+
+} // namespace asio_test
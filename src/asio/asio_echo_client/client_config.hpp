@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+namespace asio_test {
+
+enum arrival_t {
+    arrival_constant,
+    arrival_poisson
+};
+
+//
+// The options of a test client run, shared by test_client and its connections.
+//
+struct client_config {
+    std::string ip;
+    std::string port;
+    uint32_t    method;
+    // The packet size, or the min frame size of the mixed sizes (max_packet_size > packet_size).
+    uint32_t    packet_size;
+    uint32_t    max_packet_size;
+    uint32_t    thread_num;
+    uint32_t    conn_num;
+    uint32_t    pipeline;
+    std::string latency_file;
+
+    // The echo protocol, see echo_protocol_t.
+    uint32_t    protocol;
+
+    // The target rate of all of the connections (requests per second) for the
+    // open-loop test, 0 is closed-loop. arrival is arrival_t.
+    double      rate;
+    uint32_t    arrival;
+    // Carry the echo_payload header in every packet and verify the echoes.
+    bool        payload_header;
+
+    // The microseconds the io_service threads spin on poll() before blocking, 0 is run().
+    uint32_t    busy_poll;
+
+    // The idle test: the heartbeat interval of every connection (milliseconds), and the
+    // count of the loopback source ips (from 127.0.0.1) the connections are bound to,
+    // 0 is not bound (also used by the churn test).
+    uint32_t    heartbeat_interval;
+    uint32_t    source_ips;
+
+    // The churn test: the requests of every connection before it is closed and reconnected.
+    uint32_t    requests_per_conn;
+
+    // The run is warm_up_time, test_time and cool_down_time seconds long,
+    // only the test_time (the measurement window) is counted in the report.
+    uint32_t    warm_up_time;
+    uint32_t    test_time;
+    uint32_t    cool_down_time;
+    std::string report_file;
+    std::string report_format;
+};
+
+} // namespace asio_test
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <boost/noncopyable.hpp>
+
+#include "common/padding_atomic.hpp"
+#include "common/sharded_counter.hpp"
+#include "common/sharded_histogram.hpp"
+#include "common/latency_histogram.hpp"
+
+namespace asio_test {
+
+//
+// The statistics shared by all of the connections of a test client.
+//
+// The counters are sharded per thread. Every io_service thread records the latency
+// into its own slot of the sharded histogram, by its thread index.
+//
+class client_stats : private boost::noncopyable {
+private:
+    sharded_counter query_count_;
+    sharded_counter send_bytes_;
+    sharded_counter recv_bytes_;
+    sharded_counter connect_count_;
+
+    padding_atomic<uint32_t> connections_;
+    padding_atomic<uint32_t> errors_;
+
+    // The echoes checked by the payload header.
+    padding_atomic<uint64_t> lost_;
+    padding_atomic<uint64_t> reordered_;
+    padding_atomic<uint64_t> corrupted_;
+
+    sharded_histogram latency_;
+    // The connect latency of the churn test.
+    sharded_histogram connect_latency_;
+
+public:
+    client_stats()
+        : connections_(0), errors_(0), lost_(0), reordered_(0), corrupted_(0)
+    {
+    }
+
+    ~client_stats() {}
+
+    void add_query(uint64_t count) { query_count_.add(count); }
+    void add_send_bytes(uint64_t bytes) { send_bytes_.add(bytes); }
+    void add_recv_bytes(uint64_t bytes) { recv_bytes_.add(bytes); }
+
+    void add_connection() { connections_.fetch_add(1, std::memory_order_relaxed); }
+    void remove_connection() { connections_.fetch_sub(1, std::memory_order_relaxed); }
+    void add_error() { errors_.fetch_add(1, std::memory_order_relaxed); }
+    void add_lost(uint64_t count) { lost_.fetch_add(count, std::memory_order_relaxed); }
+    // A late echo was counted as lost when a later one arrived first, move it to the reordered.
+    void add_reordered()
+    {
+        reordered_.fetch_add(1, std::memory_order_relaxed);
+        lost_.fetch_sub(1, std::memory_order_relaxed);
+    }
+    void add_corrupted() { corrupted_.fetch_add(1, std::memory_order_relaxed); }
+
+    uint64_t query_count() const { return query_count_.load(); }
+    uint64_t send_bytes() const { return send_bytes_.load(); }
+    uint64_t recv_bytes() const { return recv_bytes_.load(); }
+    uint64_t connect_count() const { return connect_count_.load(); }
+    uint32_t connections() const { return connections_.load(std::memory_order_relaxed); }
+    uint32_t errors() const { return errors_.load(std::memory_order_relaxed); }
+    uint64_t lost() const { return lost_.load(std::memory_order_relaxed); }
+    uint64_t reordered() const { return reordered_.load(std::memory_order_relaxed); }
+    uint64_t corrupted() const { return corrupted_.load(std::memory_order_relaxed); }
+
+    /// Record a latency (in nanoseconds) by the io_service thread of thread_index.
+    void record_latency(std::size_t thread_index, uint64_t latency, uint64_t count = 1)
+    {
+        latency_.record_at(thread_index, latency, count);
+    }
+
+    /// Record a completed connect and its latency (in nanoseconds).
+    void record_connect(std::size_t thread_index, uint64_t latency)
+    {
+        connect_count_.add(1);
+        connect_latency_.record_at(thread_index, latency);
+    }
+
+    /// Move the latencies recorded since the last call into the interval histogram.
+    void collect_latency(latency_histogram & interval)
+    {
+        latency_.collect(interval);
+    }
+
+    /// Move the connect latencies recorded since the last call into the interval histogram.
+    void collect_connect_latency(latency_histogram & interval)
+    {
+        connect_latency_.collect(interval);
+    }
+};
+
+} // namespace asio_test
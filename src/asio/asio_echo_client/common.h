@@ -28,7 +28,9 @@ enum test_method_t {
     test_method_pingpong,
     test_method_qps,
     test_method_throughput,
-    test_method_latency
+    test_method_latency,
+    test_method_idle,
+    test_method_churn
 };
 
 } // namespace asio_test
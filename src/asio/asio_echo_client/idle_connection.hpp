@@ -0,0 +1,201 @@
+#pragma once
+
+#include <stdint.h>
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <functional>
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "common.h"
+#include "client_config.hpp"
+#include "client_stats.hpp"
+#include "socket_utils.hpp"
+#include "common/echo_frame.hpp"
+
+using namespace boost::asio;
+using namespace std::chrono;
+
+namespace asio_test {
+
+//
+// One connection of the idle test: it stays connected and only sends a heartbeat
+// (one packet) every heartbeat interval, the echo of the heartbeat completes a
+// request and its round trip time is the latency.
+//
+// It is kept as small as possible, so the client can hold hundreds of thousands of
+// connections: one buffer of packet_size bytes is shared by the heartbeat and its
+// echo, and no read is pending between the heartbeats. With the framed protocol, the
+// heartbeat is one frame and its echo is the same frame.
+//
+// With a source address, the socket is bound to it before connecting (see bind_source_address()).
+//
+class idle_connection : private boost::noncopyable {
+public:
+    typedef std::chrono::steady_clock   clock_type;
+    typedef clock_type::time_point      time_point_type;
+    typedef std::function<void ()>      connect_handler;
+
+private:
+    ip::tcp::socket socket_;
+    boost::asio::steady_timer heartbeat_timer_;
+    client_stats &  stats_;
+    std::size_t     thread_index_;
+    clock_type::duration interval_;
+    time_point_type send_time_;
+    bool            connected_;
+    bool            stopped_;
+    std::vector<char> buffer_;
+
+public:
+    idle_connection(boost::asio::io_service & io_service, client_stats & stats,
+                    const client_config & config, std::size_t thread_index)
+        : socket_(io_service), heartbeat_timer_(io_service), stats_(stats), thread_index_(thread_index),
+          interval_(std::chrono::milliseconds(config.heartbeat_interval)), connected_(false),
+          stopped_(false), buffer_(config.packet_size, 'k')
+    {
+        if (config.protocol == protocol_framed) {
+            echo_frame::write_header(buffer_.data(), config.packet_size - echo_frame::kHeaderSize,
+                                     echo_frame::frame_type_echo);
+        }
+    }
+
+    ~idle_connection()
+    {
+        boost::system::error_code ec;
+        if (socket_.is_open())
+            socket_.close(ec);
+    }
+
+    /// Connect to the server, the handler is called when the connect is completed or failed.
+    void start(const ip::tcp::endpoint & endpoint, const ip::address & source_address,
+               const connect_handler & handler)
+    {
+        // Stopped before its connect was started, the handler isn't called, so the
+        // connects of the thread end here.
+        if (stopped_)
+            return;
+
+        boost::system::error_code ec;
+        bind_source_address(socket_, endpoint, source_address, ec);
+        if (ec) {
+            handle_error("start", ec);
+            handler();
+            return;
+        }
+        do_connect(endpoint, handler);
+    }
+
+    void stop()
+    {
+        stopped_ = true;
+        boost::system::error_code ec;
+        heartbeat_timer_.cancel(ec);
+        if (socket_.is_open()) {
+            socket_.shutdown(socket_base::shutdown_both, ec);
+            socket_.close(ec);
+        }
+    }
+
+private:
+    void handle_error(const char * where, const boost::system::error_code & ec)
+    {
+        if (!stopped_ && ec != boost::asio::error::operation_aborted) {
+            std::cout << "idle_connection::" << where << "() - Error: (code = " << ec.value() << ") "
+                      << ec.message().c_str() << std::endl;
+            stats_.add_error();
+        }
+        if (connected_) {
+            connected_ = false;
+            stats_.remove_connection();
+        }
+        stop();
+    }
+
+    void do_connect(const ip::tcp::endpoint & endpoint, const connect_handler & handler)
+    {
+        socket_.async_connect(endpoint,
+            [this, handler](const boost::system::error_code & ec)
+            {
+                if (!ec) {
+                    connected_ = true;
+                    stats_.add_connection();
+
+                    socket_.set_option(ip::tcp::no_delay(true));
+
+                    // Start at a random phase, so that the heartbeats are spread over the interval.
+                    static thread_local std::mt19937 random(std::random_device{}());
+                    std::uniform_int_distribution<int64_t> phase(0, interval_.count());
+                    send_time_ = clock_type::now() + clock_type::duration(phase(random));
+                    do_wait_heartbeat();
+                }
+                else {
+                    handle_error("do_connect", ec);
+                }
+                handler();
+            });
+    }
+
+    void do_wait_heartbeat()
+    {
+        heartbeat_timer_.expires_at(send_time_);
+        heartbeat_timer_.async_wait(
+            [this](const boost::system::error_code & ec)
+            {
+                if (stopped_) {
+                    return;
+                }
+                else if (!ec) {
+                    do_heartbeat();
+                }
+                else if (ec != boost::asio::error::operation_aborted) {
+                    handle_error("do_wait_heartbeat", ec);
+                }
+            });
+    }
+
+    void do_heartbeat()
+    {
+        send_time_ = clock_type::now();
+        boost::asio::async_write(socket_, boost::asio::buffer(buffer_),
+            [this](const boost::system::error_code & ec, std::size_t send_bytes)
+            {
+                if (!ec) {
+                    stats_.add_send_bytes(send_bytes);
+                    do_read_echo();
+                }
+                else {
+                    handle_error("do_heartbeat", ec);
+                }
+            });
+    }
+
+    void do_read_echo()
+    {
+        boost::asio::async_read(socket_, boost::asio::buffer(buffer_),
+            [this](const boost::system::error_code & ec, std::size_t recv_bytes)
+            {
+                if (!ec) {
+                    time_point_type now = clock_type::now();
+                    stats_.add_recv_bytes(recv_bytes);
+                    stats_.record_latency(thread_index_,
+                        (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(now - send_time_).count());
+                    stats_.add_query(1);
+
+                    // The next heartbeat is one interval after this one, or after the echo if it is later.
+                    send_time_ += interval_;
+                    if (send_time_ < now)
+                        send_time_ = now + interval_;
+                    do_wait_heartbeat();
+                }
+                else {
+                    handle_error("do_read_echo", ec);
+                }
+            });
+    }
+};
+
+} // namespace asio_test
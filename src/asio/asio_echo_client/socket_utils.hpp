@@ -0,0 +1,40 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <boost/system/error_code.hpp>
+
+#if defined(__linux__)
+#include <netinet/in.h>
+#ifndef IP_BIND_ADDRESS_NO_PORT
+#define IP_BIND_ADDRESS_NO_PORT     24
+#endif
+#endif
+
+namespace asio_test {
+
+//
+// Open the socket and bind it to the source address before connecting, every source
+// ip of the loopback has its own range of ephemeral ports to the same server port.
+// An unspecified source address is not bound, the socket is opened by the connect.
+//
+inline void bind_source_address(boost::asio::ip::tcp::socket & socket,
+                                const boost::asio::ip::tcp::endpoint & endpoint,
+                                const boost::asio::ip::address & source_address,
+                                boost::system::error_code & ec)
+{
+    if (source_address.is_unspecified())
+        return;
+
+    socket.open(endpoint.protocol(), ec);
+    if (ec)
+        return;
+#if defined(__linux__)
+    // Choose the port at connect(), so the ports are only unique per destination.
+    int enable = 1;
+    ::setsockopt(socket.native_handle(), IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT,
+                 (const char *)&enable, sizeof(enable));
+#endif
+    socket.bind(boost::asio::ip::tcp::endpoint(source_address, 0), ec);
+}
+
+} // namespace asio_test
@@ -0,0 +1,460 @@
+#pragma once
+
+#include <stdint.h>
+#include <iostream>
+#include <iomanip>      // For std::setw()
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <boost/asio.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "common.h"
+#include "client_config.hpp"
+#include "client_stats.hpp"
+#include "test_connection.hpp"
+#include "idle_connection.hpp"
+#include "churn_connection.hpp"
+#include "test_report.hpp"
+#include "common/latency_histogram.hpp"
+#include "common/busy_poll.hpp"
+
+using namespace boost::asio;
+using namespace std::chrono;
+
+namespace asio_test {
+
+//
+// A load generator: conn_num connections spread over thread_num io_service threads,
+// every connection keeps pipeline requests in flight. The main thread reports the
+// statistics of all of the connections once per second.
+//
+// The idle test holds conn_num mostly idle connections instead, every one only sends a
+// heartbeat per interval. They are connected by a few at a time per thread, so a large
+// conn_num doesn't overflow the listen backlog of the server.
+//
+// The churn test runs conn_num connection slots instead, every one connects, sends a
+// few requests and closes in a loop, the connects per second and the connect latency
+// are reported besides the qps.
+//
+// A run has three phases: the warm-up, the measurement window and the cool-down.
+// The load is kept during the whole run, but only the measurement window is counted
+// into the total latency and the final report, so the connecting, the cold caches
+// and the closing of the connections don't disturb the result.
+//
+class test_client : private boost::noncopyable {
+private:
+    typedef std::shared_ptr<boost::asio::io_service>        io_service_ptr;
+    typedef std::shared_ptr<boost::asio::io_service::work>  work_ptr;
+
+    client_config   config_;
+    client_stats    stats_;
+
+    std::vector<io_service_ptr>     io_services_;
+    std::vector<work_ptr>           works_;
+    std::vector< std::shared_ptr<std::thread> >     threads_;
+    std::vector< std::unique_ptr<test_connection> > connections_;
+
+    // The idle test: the connections, and the next one to connect of every thread.
+    std::vector< std::unique_ptr<idle_connection> > idle_connections_;
+    std::vector<std::size_t>    next_connects_;
+    ip::tcp::endpoint           endpoint_;
+
+    std::vector< std::unique_ptr<churn_connection> > churn_connections_;
+
+    latency_histogram interval_latency_;
+    latency_histogram total_latency_;
+    latency_histogram interval_connect_latency_;
+    latency_histogram total_connect_latency_;
+
+    enum phase_t {
+        phase_warm_up,
+        phase_measure,
+        phase_cool_down
+    };
+
+    // The counters at the beginning of the measurement window.
+    uint64_t    start_query_count_;
+    uint64_t    start_send_bytes_;
+    uint64_t    start_recv_bytes_;
+    uint64_t    start_connect_count_;
+    uint32_t    start_errors_;
+    uint64_t    start_lost_;
+    uint64_t    start_reordered_;
+    uint64_t    start_corrupted_;
+    time_point<high_resolution_clock> start_time_;
+
+    test_report report_;
+
+public:
+    explicit test_client(const client_config & config)
+        : config_(config),
+          start_query_count_(0), start_send_bytes_(0), start_recv_bytes_(0), start_connect_count_(0), start_errors_(0),
+          start_lost_(0), start_reordered_(0), start_corrupted_(0)
+    {
+        for (uint32_t i = 0; i < config_.thread_num; ++i) {
+            io_service_ptr io_service = std::make_shared<boost::asio::io_service>();
+            io_services_.push_back(io_service);
+            works_.push_back(std::make_shared<boost::asio::io_service::work>(*io_service));
+        }
+    }
+
+    ~test_client()
+    {
+        stop();
+    }
+
+    void start()
+    {
+        ip::tcp::resolver resolver(*io_services_[0]);
+        ip::tcp::resolver::iterator endpoint_iterator = resolver.resolve({ config_.ip, config_.port });
+
+        if (config_.method == test_method_idle) {
+            start_idle_connections(*endpoint_iterator);
+        }
+        else if (config_.method == test_method_churn) {
+            for (uint32_t i = 0; i < config_.conn_num; ++i) {
+                std::size_t index = i % io_services_.size();
+                std::unique_ptr<churn_connection> connection(new churn_connection(*io_services_[index], stats_,
+                    config_, index));
+                connection->start(*endpoint_iterator, get_source_address(i));
+                churn_connections_.push_back(std::move(connection));
+            }
+        }
+        else {
+            // Spread the connections over the io_services by round-robin.
+            for (uint32_t i = 0; i < config_.conn_num; ++i) {
+                std::size_t index = i % io_services_.size();
+                std::unique_ptr<test_connection> connection(new test_connection(*io_services_[index], stats_,
+                    config_, index, i));
+                connection->start(endpoint_iterator);
+                connections_.push_back(std::move(connection));
+            }
+        }
+
+        for (std::size_t i = 0; i < io_services_.size(); ++i) {
+            io_service_ptr io_service = io_services_[i];
+            uint32_t spin_us = config_.busy_poll;
+            threads_.push_back(std::make_shared<std::thread>([io_service, spin_us] {
+                run_spin_then_park(*io_service, spin_us);
+            }));
+        }
+    }
+
+    /// Stop the connections by the threads of their io_services, and wait for the threads
+    /// to run out of the work: the stops, the aborted operations and the handlers which
+    /// were already queued are all run before the connections are destroyed.
+    void stop()
+    {
+        for (std::size_t i = 0; i < connections_.size(); ++i) {
+            io_services_[i % io_services_.size()]->post([this, i] { connections_[i]->stop(); });
+        }
+        for (std::size_t i = 0; i < idle_connections_.size(); ++i) {
+            io_services_[i % io_services_.size()]->post([this, i] { idle_connections_[i]->stop(); });
+        }
+        for (std::size_t i = 0; i < churn_connections_.size(); ++i) {
+            io_services_[i % io_services_.size()]->post([this, i] { churn_connections_[i]->stop(); });
+        }
+        works_.clear();
+        for (std::size_t i = 0; i < threads_.size(); ++i) {
+            if (threads_[i]->joinable())
+                threads_[i]->join();
+        }
+        threads_.clear();
+        connections_.clear();
+        idle_connections_.clear();
+        churn_connections_.clear();
+    }
+
+    /// Run the warm-up, the measurement window and the cool-down, displaying the
+    /// statistics once per second, then stop the connections and write the report.
+    void run()
+    {
+        uint32_t measure_begin = config_.warm_up_time;
+        uint32_t measure_end = measure_begin + config_.test_time;
+        uint32_t total_time = measure_end + config_.cool_down_time;
+
+        phase_t phase = phase_warm_up;
+        if (measure_begin == 0) {
+            begin_measure();
+            phase = phase_measure;
+        }
+
+        uint64_t last_query_count = 0, last_send_bytes = 0, last_recv_bytes = 0, last_connect_count = 0;
+        time_point<high_resolution_clock> last_time = high_resolution_clock::now();
+        for (uint32_t seconds = 1; seconds <= total_time; ++seconds) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+
+            time_point<high_resolution_clock> now_time = high_resolution_clock::now();
+            double elapsed_time = duration_cast< duration<double> >(now_time - last_time).count();
+            last_time = now_time;
+
+            uint64_t query_count = stats_.query_count();
+            uint64_t send_bytes = stats_.send_bytes();
+            uint64_t recv_bytes = stats_.recv_bytes();
+            uint64_t connect_count = stats_.connect_count();
+            stats_.collect_latency(interval_latency_);
+            stats_.collect_connect_latency(interval_connect_latency_);
+            if (phase == phase_measure) {
+                total_latency_.merge(interval_latency_);
+                total_connect_latency_.merge(interval_connect_latency_);
+            }
+
+            display_counters(get_phase_name(phase), elapsed_time, query_count - last_query_count,
+                             send_bytes - last_send_bytes, recv_bytes - last_recv_bytes,
+                             connect_count - last_connect_count);
+
+            last_query_count = query_count;
+            last_send_bytes = send_bytes;
+            last_recv_bytes = recv_bytes;
+            last_connect_count = connect_count;
+
+            if (phase == phase_warm_up && seconds >= measure_begin) {
+                begin_measure();
+                phase = phase_measure;
+            }
+            if (phase == phase_measure && seconds >= measure_end) {
+                end_measure();
+                phase = phase_cool_down;
+            }
+        }
+
+        stop();
+
+        display_report();
+        if (!config_.latency_file.empty())
+            export_latency();
+        if (!config_.report_file.empty())
+            write_report();
+    }
+
+private:
+    void start_idle_connections(const ip::tcp::endpoint & endpoint)
+    {
+        // The connects in flight per thread.
+        static const uint32_t kMaxConnecting = 64;
+
+        endpoint_ = endpoint;
+        for (uint32_t i = 0; i < config_.conn_num; ++i) {
+            std::size_t index = i % io_services_.size();
+            idle_connections_.push_back(std::unique_ptr<idle_connection>(
+                new idle_connection(*io_services_[index], stats_, config_, index)));
+        }
+
+        // The connections of a thread are connected in order, every completed connect starts
+        // the next one, the threads are not started yet.
+        next_connects_.resize(io_services_.size());
+        for (std::size_t i = 0; i < io_services_.size(); ++i) {
+            next_connects_[i] = i;
+            for (uint32_t j = 0; j < kMaxConnecting; ++j) {
+                connect_next(i);
+            }
+        }
+    }
+
+    void connect_next(std::size_t thread_index)
+    {
+        std::size_t conn_index = next_connects_[thread_index];
+        if (conn_index >= idle_connections_.size())
+            return;
+        next_connects_[thread_index] = conn_index + io_services_.size();
+
+        idle_connections_[conn_index]->start(endpoint_, get_source_address(conn_index),
+            [this, thread_index] { connect_next(thread_index); });
+    }
+
+    /// Spread the connections over the loopback source ips from 127.0.0.1,
+    /// the unspecified address is not bound.
+    ip::address get_source_address(std::size_t conn_index) const
+    {
+        ip::address source_address;
+        if (config_.source_ips > 0)
+            source_address = ip::address_v4((uint32_t)(0x7F000001UL + conn_index % config_.source_ips));
+        return source_address;
+    }
+
+    static const char * get_phase_name(phase_t phase)
+    {
+        switch (phase) {
+        case phase_warm_up:
+            return "warm-up";
+        case phase_measure:
+            return "measure";
+        case phase_cool_down:
+            return "cool-down";
+        default:
+            return "unknown";
+        }
+    }
+
+    static const char * get_arrival_name(uint32_t arrival, double rate)
+    {
+        if (rate <= 0.0)
+            return "closed-loop";
+        return ((arrival == arrival_poisson) ? "poisson" : "constant");
+    }
+
+    void begin_measure()
+    {
+        start_query_count_ = stats_.query_count();
+        start_send_bytes_ = stats_.send_bytes();
+        start_recv_bytes_ = stats_.recv_bytes();
+        start_connect_count_ = stats_.connect_count();
+        start_errors_ = stats_.errors();
+        start_lost_ = stats_.lost();
+        start_reordered_ = stats_.reordered();
+        start_corrupted_ = stats_.corrupted();
+        start_time_ = high_resolution_clock::now();
+        total_latency_.reset();
+        total_connect_latency_.reset();
+    }
+
+    void end_measure()
+    {
+        time_point<high_resolution_clock> end_time = high_resolution_clock::now();
+
+        report_.host        = config_.ip;
+        report_.port        = config_.port;
+        report_.mode        = g_test_mode_str;
+        report_.method      = g_test_method_str;
+        report_.packet_size = config_.packet_size;
+        report_.max_packet_size = config_.max_packet_size;
+        report_.protocol    = (config_.protocol == protocol_framed) ? "framed" : "raw";
+        report_.thread_num  = config_.thread_num;
+        report_.conn_num    = config_.conn_num;
+        report_.pipeline    = config_.pipeline;
+        report_.target_rate = config_.rate;
+        report_.arrival     = get_arrival_name(config_.arrival, config_.rate);
+
+        report_.duration    = duration_cast< duration<double> >(end_time - start_time_).count();
+        report_.query_count = stats_.query_count() - start_query_count_;
+        report_.send_bytes  = stats_.send_bytes() - start_send_bytes_;
+        report_.recv_bytes  = stats_.recv_bytes() - start_recv_bytes_;
+        report_.connect_count = stats_.connect_count() - start_connect_count_;
+        report_.connections = stats_.connections();
+        report_.errors      = stats_.errors() - start_errors_;
+        report_.payload_header = config_.payload_header;
+        report_.lost        = stats_.lost() - start_lost_;
+        report_.reordered   = stats_.reordered() - start_reordered_;
+        report_.corrupted   = stats_.corrupted() - start_corrupted_;
+        report_.latency.reset();
+        report_.latency.merge(total_latency_);
+        report_.connect_latency.reset();
+        report_.connect_latency.merge(total_connect_latency_);
+    }
+
+    static void display_latency(const char * title, const latency_histogram & histogram)
+    {
+        // The histogram values are in nanoseconds, display them in microseconds.
+        std::cout << title
+                  << std::setiosflags(std::ios::fixed) << std::setprecision(3)
+                  << "p50 = "     << std::setw(9) << (histogram.value_at_percentile(50.0) / 1000.0)
+                  << ", p90 = "   << std::setw(9) << (histogram.value_at_percentile(90.0) / 1000.0)
+                  << ", p99 = "   << std::setw(9) << (histogram.value_at_percentile(99.0) / 1000.0)
+                  << ", p99.9 = " << std::setw(9) << (histogram.value_at_percentile(99.9) / 1000.0)
+                  << ", max = "   << std::setw(9) << (histogram.max_value() / 1000.0)
+                  << ", mean = "  << std::setw(9) << (histogram.mean() / 1000.0)
+                  << " us, query count = " << histogram.count() << std::endl;
+        std::cout << std::resetiosflags(std::ios::fixed);
+    }
+
+    void display_counters(const char * phase_name, double elapsed_time, uint64_t query_count,
+                          uint64_t send_bytes, uint64_t recv_bytes, uint64_t connect_count)
+    {
+        if (elapsed_time <= 0.0)
+            elapsed_time = 1.0;
+        std::cout << "[" << phase_name << "] "
+                  << config_.ip.c_str() << ":" << config_.port.c_str() << " - "
+                  << config_.packet_size;
+        if (config_.max_packet_size > config_.packet_size)
+            std::cout << "-" << config_.max_packet_size;
+        std::cout << " bytes : "
+                  << config_.thread_num << " threads : "
+                  << "[" << std::left << std::setw(4) << stats_.connections() << "] conns : ";
+        if (config_.method == test_method_idle)
+            std::cout << "heartbeat = " << config_.heartbeat_interval << " ms, ";
+        else if (config_.method == test_method_churn)
+            std::cout << "requests/conn = " << config_.requests_per_conn << ", "
+                      << "conns/s = " << std::right << std::setw(7) << (uint64_t)(connect_count / elapsed_time) << ", ";
+        else
+            std::cout << "pipeline = " << config_.pipeline << ", ";
+        if (config_.rate > 0.0)
+            std::cout << "rate = " << (uint64_t)config_.rate << " (" << get_arrival_name(config_.arrival, config_.rate) << "), ";
+        std::cout << "qps = " << std::right << std::setw(8) << (uint64_t)(query_count / elapsed_time) << ", "
+                  << std::setiosflags(std::ios::fixed) << std::setprecision(3)
+                  << "Send BW: " << std::setw(8) << (send_bytes / elapsed_time / (1024.0 * 1024.0)) << " MB/s, "
+                  << "Recv BW: " << std::setw(8) << (recv_bytes / elapsed_time / (1024.0 * 1024.0)) << " MB/s, "
+                  << "errors = " << stats_.errors() << std::endl;
+        std::cout << std::resetiosflags(std::ios::fixed);
+        if (config_.payload_header) {
+            std::cout << "echoes        : lost = " << stats_.lost() << ", reordered = " << stats_.reordered()
+                      << ", corrupted = " << stats_.corrupted() << std::endl;
+        }
+
+        if (config_.method != test_method_throughput) {
+            // The latency of the last interval (about one second) and the measurement window.
+            display_latency("latency       : ", interval_latency_);
+            display_latency("latency total : ", total_latency_);
+        }
+        if (config_.method == test_method_churn) {
+            display_latency("connect       : ", interval_connect_latency_);
+            display_latency("connect total : ", total_connect_latency_);
+        }
+        std::cout << std::endl;
+    }
+
+    void display_report()
+    {
+        std::cout << "Measured " << std::setiosflags(std::ios::fixed) << std::setprecision(3)
+                  << report_.duration << " seconds: "
+                  << "query count = " << report_.query_count << ", "
+                  << "qps = " << report_.qps() << ", "
+                  << "Send BW: " << report_.send_bandwidth() << " MB/s, "
+                  << "Recv BW: " << report_.recv_bandwidth() << " MB/s, "
+                  << "errors = " << report_.errors << std::endl;
+        std::cout << std::resetiosflags(std::ios::fixed);
+        if (report_.payload_header) {
+            std::cout << "echoes        : lost = " << report_.lost << ", reordered = " << report_.reordered
+                      << ", corrupted = " << report_.corrupted << std::endl;
+        }
+        if (config_.method != test_method_throughput) {
+            display_latency("latency       : ", report_.latency);
+        }
+        if (config_.method == test_method_churn) {
+            std::cout << "connects      : count = " << report_.connect_count << ", "
+                      << std::setiosflags(std::ios::fixed) << std::setprecision(3)
+                      << "conns/s = " << report_.connect_rate() << std::endl;
+            std::cout << std::resetiosflags(std::ios::fixed);
+            display_latency("connect       : ", report_.connect_latency);
+        }
+        std::cout << std::endl;
+    }
+
+    void write_report()
+    {
+        if (report_.write(config_.report_file, config_.report_format)) {
+            std::cout << "Report is written to \"" << config_.report_file.c_str() << "\"." << std::endl;
+        }
+        else {
+            std::cout << "test_client::write_report() - Error: can't write the file \""
+                      << config_.report_file.c_str() << "\"." << std::endl;
+        }
+    }
+
+    void export_latency()
+    {
+        std::ofstream ofs(config_.latency_file.c_str(), std::ios::out | std::ios::trunc);
+        if (ofs.is_open()) {
+            report_.latency.export_percentiles(ofs);
+        }
+        else {
+            std::cout << "test_client::export_latency() - Error: can't open the file \""
+                      << config_.latency_file.c_str() << "\"." << std::endl;
+        }
+    }
+};
+
+} // namespace asio_test
@@ -0,0 +1,510 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <iostream>
+#include <deque>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "common.h"
+#include "client_config.hpp"
+#include "client_stats.hpp"
+#include "common/echo_frame.hpp"
+#include "common/echo_payload.hpp"
+
+using namespace boost::asio;
+using namespace std::chrono;
+
+namespace asio_test {
+
+//
+// One connection of the test client.
+//
+// For pingpong, qps and latency, it keeps pipeline requests in flight: every echoed
+// packet completes a request, records its latency and sends a new one. The read is
+// always armed, the new requests are sent by one write while the last write is
+// still pending.
+//
+// For throughput, it writes the packets back to back and only drains the echoes.
+//
+// With a target rate (requests per second), the requests are sent open-loop: they
+// are scheduled at fixed or Poisson distributed intervals, independent of the
+// responses, and the latency is measured from the intended send time. So a stall of
+// the server delays the requests behind it, and the waiting is counted into their
+// latency, instead of silently pausing the schedule (the coordinated omission).
+// The pipeline is then the max number of packets sent by one write.
+//
+// With the payload header, every packet carries its sequence number and send time
+// (see echo_payload), the latency is taken from the echoed header of each packet,
+// and the lost, reordered and corrupted echoes are counted. A skipped sequence is counted
+// as lost, if it arrives later within the last kSequenceWindow sequences, it is moved from
+// the lost to the reordered, a duplicate or an older one is not counted again.
+//
+// With the framed protocol, every request is an echo_frame, its size is packet_size,
+// or random in [packet_size, max_packet_size] for the mixed sizes, the echoed frames
+// are parsed from the receive buffer, so the responses are matched exactly.
+//
+class test_connection : private boost::noncopyable {
+public:
+    typedef std::chrono::steady_clock   clock_type;
+    typedef clock_type::time_point      time_point_type;
+
+    // The skipped sequences which can still be recognized as reordered (the bits of skipped_sequences_).
+    static const uint64_t kSequenceWindow = 64;
+
+private:
+    boost::asio::io_service & io_service_;
+    ip::tcp::socket socket_;
+    client_stats &  stats_;
+    std::size_t     thread_index_;
+    uint32_t        method_;
+    uint32_t        packet_size_;
+    uint32_t        max_packet_size_;
+    uint32_t        pipeline_;
+    uint32_t        protocol_;
+
+    // The (intended) send times of the requests in flight, in the sending order.
+    std::deque<time_point_type> send_times_;
+
+    // The requests issued but waiting for the pending write.
+    uint32_t        pending_requests_;
+    bool            writing_;
+    uint32_t        recv_remain_;
+    bool            connected_;
+    bool            stopped_;
+
+    // The open-loop schedule, rate_ is the requests per second of this connection.
+    double          rate_;
+    uint32_t        arrival_;
+    boost::asio::steady_timer send_timer_;
+    time_point_type next_send_time_;
+    std::mt19937_64 random_;
+
+    // The payload header.
+    uint32_t        conn_id_;
+    bool            payload_header_;
+    uint32_t        body_hash_;
+    uint64_t        next_sequence_;
+    uint64_t        expected_sequence_;
+    // Bit i is set if the sequence (expected_sequence_ - 1 - i) was skipped and counted as lost.
+    uint64_t        skipped_sequences_;
+    // The partial packet of the last read (the raw protocol).
+    std::vector<char> packet_buffer_;
+
+    std::vector<char> send_buffer_;
+    std::vector<char> recv_buffer_;
+
+public:
+    test_connection(boost::asio::io_service & io_service, client_stats & stats,
+                    const client_config & config, std::size_t thread_index, uint32_t conn_id)
+        : io_service_(io_service), socket_(io_service), stats_(stats),
+          thread_index_(thread_index), method_(config.method), packet_size_(config.packet_size),
+          max_packet_size_(config.packet_size), pipeline_(config.pipeline), protocol_(config.protocol),
+          pending_requests_(0), writing_(false), recv_remain_(0), connected_(false), stopped_(false),
+          rate_(config.rate / config.conn_num), arrival_(config.arrival), send_timer_(io_service),
+          random_(std::random_device()() ^ (uint64_t)this),
+          conn_id_(conn_id), payload_header_(config.payload_header && config.method != test_method_throughput),
+          body_hash_(0), next_sequence_(0), expected_sequence_(0),
+          skipped_sequences_(0)
+    {
+        // The mixed sizes need the frames to find the boundaries of the echoes.
+        if (protocol_ == protocol_framed && config.max_packet_size > packet_size_
+            && method_ != test_method_throughput)
+            max_packet_size_ = config.max_packet_size;
+
+        send_buffer_.resize(max_packet_size_ * pipeline_, 'k');
+        std::size_t recv_size = (max_packet_size_ * pipeline_ < MAX_PACKET_SIZE) ? MAX_PACKET_SIZE : (max_packet_size_ * pipeline_);
+        if (protocol_ == protocol_framed) {
+            // Keep the room of an incomplete frame at the front.
+            recv_size += max_packet_size_;
+        }
+        recv_buffer_.resize(recv_size);
+
+        if (payload_header_) {
+            if (protocol_ == protocol_raw)
+                packet_buffer_.resize(packet_size_);
+            uint32_t payload_offset = get_payload_offset();
+            body_hash_ = echo_payload::body_checksum(send_buffer_.data() + payload_offset, packet_size_ - payload_offset);
+        }
+        if (protocol_ == protocol_framed && method_ == test_method_throughput) {
+            // The frames of the throughput test are never changed.
+            for (uint32_t i = 0; i < pipeline_; ++i) {
+                echo_frame::write_header(send_buffer_.data() + i * packet_size_,
+                                         packet_size_ - echo_frame::kHeaderSize, echo_frame::frame_type_echo);
+            }
+        }
+    }
+
+    ~test_connection()
+    {
+        boost::system::error_code ec;
+        if (socket_.is_open())
+            socket_.close(ec);
+    }
+
+    void start(ip::tcp::resolver::iterator endpoint_iterator)
+    {
+        do_connect(endpoint_iterator);
+    }
+
+    bool is_open_loop() const
+    {
+        return (rate_ > 0.0 && method_ != test_method_throughput);
+    }
+
+    void stop()
+    {
+        stopped_ = true;
+        boost::system::error_code ec;
+        send_timer_.cancel(ec);
+        if (socket_.is_open()) {
+            socket_.shutdown(socket_base::shutdown_both, ec);
+            socket_.close(ec);
+        }
+    }
+
+private:
+    void handle_error(const char * where, const boost::system::error_code & ec)
+    {
+        if (!stopped_ && ec != boost::asio::error::operation_aborted) {
+            std::cout << "test_connection::" << where << "() - Error: (code = " << ec.value() << ") "
+                      << ec.message().c_str() << std::endl;
+            stats_.add_error();
+        }
+        if (connected_) {
+            connected_ = false;
+            stats_.remove_connection();
+        }
+        stop();
+    }
+
+    void do_connect(ip::tcp::resolver::iterator endpoint_iterator)
+    {
+        boost::asio::async_connect(socket_, endpoint_iterator,
+            [this](const boost::system::error_code & ec, ip::tcp::resolver::iterator)
+            {
+                if (!ec) {
+                    connected_ = true;
+                    stats_.add_connection();
+
+                    socket_.set_option(ip::tcp::no_delay(true));
+
+                    do_read_some();
+                    if (method_ == test_method_throughput) {
+                        do_write(packet_size_ * pipeline_);
+                    }
+                    else if (is_open_loop()) {
+                        // Start at a random phase, so that the connections don't send at the same instants.
+                        std::uniform_real_distribution<double> phase(0.0, 1.0);
+                        next_send_time_ = clock_type::now() + get_nanoseconds(phase(random_) / rate_);
+                        do_wait_send_time();
+                    }
+                    else {
+                        send_requests(pipeline_);
+                    }
+                }
+                else {
+                    handle_error("do_connect", ec);
+                }
+            });
+    }
+
+    uint32_t get_payload_offset() const
+    {
+        return ((protocol_ == protocol_framed) ? echo_frame::kHeaderSize : 0);
+    }
+
+    uint32_t next_packet_size()
+    {
+        if (max_packet_size_ > packet_size_) {
+            std::uniform_int_distribution<uint32_t> packet_size(packet_size_, max_packet_size_);
+            return packet_size(random_);
+        }
+        return packet_size_;
+    }
+
+    static clock_type::duration get_nanoseconds(double seconds)
+    {
+        return std::chrono::duration_cast<clock_type::duration>(std::chrono::nanoseconds((int64_t)(seconds * 1E9)));
+    }
+
+    /// The interval to the next request of the open-loop schedule, in seconds.
+    double next_interval()
+    {
+        if (arrival_ == arrival_poisson) {
+            std::exponential_distribution<double> exponential(rate_);
+            return exponential(random_);
+        }
+        return (1.0 / rate_);
+    }
+
+    void do_wait_send_time()
+    {
+        send_timer_.expires_at(next_send_time_);
+        send_timer_.async_wait(
+            [this](const boost::system::error_code & ec)
+            {
+                if (stopped_) {
+                    return;
+                }
+                else if (!ec) {
+                    // Issue all of the requests which are due, even if the timer fires late,
+                    // each one is stamped with its intended send time.
+                    time_point_type now = clock_type::now();
+                    while (next_send_time_ <= now) {
+                        send_times_.push_back(next_send_time_);
+                        pending_requests_++;
+                        next_send_time_ += get_nanoseconds(next_interval());
+                    }
+                    flush_requests();
+                    do_wait_send_time();
+                }
+                else if (ec != boost::asio::error::operation_aborted) {
+                    handle_error("do_wait_send_time", ec);
+                }
+            });
+    }
+
+    void send_requests(uint32_t request_count)
+    {
+        time_point_type now = clock_type::now();
+        for (uint32_t i = 0; i < request_count; ++i) {
+            send_times_.push_back(now);
+        }
+        pending_requests_ += request_count;
+        flush_requests();
+    }
+
+    void flush_requests()
+    {
+        // Only one write can be pending, the others are sent when it's completed.
+        if (writing_ || pending_requests_ == 0)
+            return;
+
+        uint32_t request_count = (pending_requests_ < pipeline_) ? pending_requests_ : pipeline_;
+        pending_requests_ -= request_count;
+        if (protocol_ == protocol_raw && !payload_header_) {
+            do_write(packet_size_ * request_count);
+            return;
+        }
+
+        // The requests to write are in front of the pending requests.
+        std::size_t queued = pending_requests_ + request_count;
+        std::size_t first = (send_times_.size() > queued) ? (send_times_.size() - queued) : 0;
+        uint32_t payload_offset = get_payload_offset();
+        std::size_t send_bytes = 0;
+        for (uint32_t i = 0; i < request_count; ++i) {
+            char * packet = send_buffer_.data() + send_bytes;
+            uint32_t packet_size = next_packet_size();
+            if (protocol_ == protocol_framed) {
+                echo_frame::write_header(packet, packet_size - echo_frame::kHeaderSize, echo_frame::frame_type_echo);
+            }
+            if (payload_header_) {
+                char * payload = packet + payload_offset;
+                uint32_t payload_size = packet_size - payload_offset;
+                // With the mixed sizes, the body may hold the stale headers of the last writes.
+                uint32_t body_hash = (max_packet_size_ == packet_size_) ? body_hash_ :
+                                     echo_payload::body_checksum(payload, payload_size);
+                uint64_t timestamp = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                        send_times_[first + i].time_since_epoch()).count();
+                echo_payload::write_header(payload, payload_size, body_hash, next_sequence_++, timestamp, conn_id_);
+            }
+            send_bytes += packet_size;
+        }
+        do_write(send_bytes);
+    }
+
+    void complete_requests(uint32_t request_count)
+    {
+        time_point_type now = clock_type::now();
+        for (uint32_t i = 0; i < request_count && !send_times_.empty(); ++i) {
+            uint64_t latency = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(now - send_times_.front()).count();
+            stats_.record_latency(thread_index_, latency);
+            send_times_.pop_front();
+        }
+        stats_.add_query(request_count);
+    }
+
+    /// Check an echoed packet by its payload header and record its latency.
+    void check_packet(const char * packet, uint32_t packet_size, time_point_type now)
+    {
+        echo_payload_header header;
+        echo_payload::verify_result_t result = echo_payload::read_header(packet, packet_size, header);
+        if (result == echo_payload::verify_ok && header.conn_id == conn_id_) {
+            if (header.sequence >= expected_sequence_) {
+                uint64_t skipped = header.sequence - expected_sequence_;
+                if (skipped > 0)
+                    stats_.add_lost(skipped);
+                advance_sequence(skipped);
+            }
+            else {
+                uint64_t distance = expected_sequence_ - 1 - header.sequence;
+                uint64_t bit = (distance < kSequenceWindow) ? (1ULL << distance) : 0;
+                if ((skipped_sequences_ & bit) != 0) {
+                    // It was counted as lost, move it to the reordered.
+                    skipped_sequences_ &= ~bit;
+                    stats_.add_reordered();
+                }
+            }
+            int64_t latency = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count()
+                              - (int64_t)header.timestamp;
+            stats_.record_latency(thread_index_, (latency > 0) ? (uint64_t)latency : 0);
+        }
+        else {
+            // The corrupted echo still takes the place of the next sequence.
+            stats_.add_corrupted();
+            advance_sequence(0);
+        }
+        // Only an echo of a request in flight takes its send time, the duplicated or
+        // the extra echoes of a faulty server don't take the times of the pending requests.
+        if (send_times_.size() > pending_requests_)
+            send_times_.pop_front();
+    }
+
+    /// Take the expected sequence after skipping the skipped sequences before it.
+    void advance_sequence(uint64_t skipped)
+    {
+        // The window moves by (skipped + 1), the skipped sequences are the bits 1 to skipped.
+        uint64_t shift = skipped + 1;
+        skipped_sequences_ = (shift < kSequenceWindow) ? (skipped_sequences_ << shift) : 0;
+        uint64_t skipped_bits = (skipped < kSequenceWindow) ? skipped : (kSequenceWindow - 1);
+        if (skipped_bits > 0)
+            skipped_sequences_ |= (((1ULL << skipped_bits) - 1) << 1);
+        expected_sequence_ += shift;
+    }
+
+    /// Check the echoed packets of a read, keep the partial packet for the next read.
+    uint32_t receive_packets(const char * data, uint32_t size)
+    {
+        time_point_type now = clock_type::now();
+        uint32_t request_count = 0;
+        if (recv_remain_ > 0) {
+            uint32_t copy_size = packet_size_ - recv_remain_;
+            if (copy_size > size)
+                copy_size = size;
+            ::memcpy(packet_buffer_.data() + recv_remain_, data, copy_size);
+            recv_remain_ += copy_size;
+            data += copy_size;
+            size -= copy_size;
+            if (recv_remain_ < packet_size_)
+                return 0;
+            check_packet(packet_buffer_.data(), packet_size_, now);
+            recv_remain_ = 0;
+            request_count++;
+        }
+        while (size >= packet_size_) {
+            check_packet(data, packet_size_, now);
+            data += packet_size_;
+            size -= packet_size_;
+            request_count++;
+        }
+        if (size > 0) {
+            ::memcpy(packet_buffer_.data(), data, size);
+            recv_remain_ = size;
+        }
+        if (request_count > 0)
+            stats_.add_query(request_count);
+        return request_count;
+    }
+
+    /// Check the echoed frames in front of the receive buffer, move the incomplete frame
+    /// to the front. Return the number of the frames, or -1 if the stream is broken.
+    int receive_frames(uint32_t size)
+    {
+        time_point_type now = clock_type::now();
+        uint32_t consumed = 0;
+        int frame_count = echo_frame::parse(recv_buffer_.data(), size, MAX_PACKET_SIZE, consumed,
+            [this, now](const char * frame, uint32_t frame_size, const echo_frame_header &)
+            {
+                if (payload_header_)
+                    check_packet(frame + echo_frame::kHeaderSize, frame_size - echo_frame::kHeaderSize, now);
+            });
+        if (frame_count < 0)
+            return -1;
+
+        if (frame_count > 0) {
+            if (payload_header_)
+                stats_.add_query(frame_count);
+            else
+                complete_requests(frame_count);
+        }
+        recv_remain_ = size - consumed;
+        if (consumed > 0 && recv_remain_ > 0)
+            ::memmove(recv_buffer_.data(), recv_buffer_.data() + consumed, recv_remain_);
+        return frame_count;
+    }
+
+    void do_write(std::size_t send_size)
+    {
+        writing_ = true;
+        boost::asio::async_write(socket_,
+            boost::asio::buffer(send_buffer_.data(), send_size),
+            [this](const boost::system::error_code & ec, std::size_t send_bytes)
+            {
+                writing_ = false;
+                if (!ec) {
+                    stats_.add_send_bytes(send_bytes);
+                    if (method_ == test_method_throughput) {
+                        stats_.add_query(send_bytes / packet_size_);
+                        do_write(packet_size_ * pipeline_);
+                    }
+                    else {
+                        flush_requests();
+                    }
+                }
+                else {
+                    handle_error("do_write", ec);
+                }
+            });
+    }
+
+    void do_read_some()
+    {
+        // The framed protocol appends to the incomplete frame of the last read.
+        std::size_t offset = (protocol_ == protocol_framed && method_ != test_method_throughput) ? recv_remain_ : 0;
+        socket_.async_read_some(boost::asio::buffer(recv_buffer_.data() + offset, recv_buffer_.size() - offset),
+            [this](const boost::system::error_code & ec, std::size_t recv_bytes)
+            {
+                if (!ec) {
+                    stats_.add_recv_bytes(recv_bytes);
+                    if (method_ != test_method_throughput) {
+                        // Every echoed packet completes a request.
+                        uint32_t request_count;
+                        if (protocol_ == protocol_framed) {
+                            int frame_count = receive_frames(recv_remain_ + (uint32_t)recv_bytes);
+                            if (frame_count < 0) {
+                                // The stream can't be resynchronized after a bad frame.
+                                stats_.add_corrupted();
+                                handle_error("receive_frames", boost::system::errc::make_error_code(boost::system::errc::bad_message));
+                                return;
+                            }
+                            request_count = (uint32_t)frame_count;
+                        }
+                        else if (payload_header_) {
+                            request_count = receive_packets(recv_buffer_.data(), (uint32_t)recv_bytes);
+                        }
+                        else {
+                            uint32_t total_bytes = recv_remain_ + (uint32_t)recv_bytes;
+                            request_count = total_bytes / packet_size_;
+                            recv_remain_ = total_bytes - request_count * packet_size_;
+                            if (request_count > 0)
+                                complete_requests(request_count);
+                        }
+                        if (request_count > 0 && !is_open_loop())
+                            send_requests(request_count);
+                    }
+                    do_read_some();
+                }
+                else {
+                    handle_error("do_read_some", ec);
+                }
+            });
+    }
+};
+
+} // namespace asio_test
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <stdint.h>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+
+#include "common/latency_histogram.hpp"
+
+namespace asio_test {
+
+//
+// The summary of the measurement window of a timed run, written as JSON or CSV
+// for the regression scripts to compare the server builds.
+//
+// The JSON file is overwritten, the CSV file is appended one row per run (the
+// header is written only if the file is empty), so a series of runs can share it.
+//
+struct test_report {
+    std::string host;
+    std::string port;
+    std::string mode;
+    std::string method;
+    std::string protocol;
+    uint32_t    packet_size;
+    uint32_t    max_packet_size;
+    uint32_t    thread_num;
+    uint32_t    conn_num;
+    uint32_t    pipeline;
+    // The target rate of the open-loop test, 0 is closed-loop.
+    double      target_rate;
+    std::string arrival;
+
+    // The length of the measurement window, in seconds.
+    double      duration;
+    uint64_t    query_count;
+    uint64_t    send_bytes;
+    uint64_t    recv_bytes;
+    // The completed connects (the churn test).
+    uint64_t    connect_count;
+    uint32_t    connections;
+    uint32_t    errors;
+
+    // The echoes checked by the payload header.
+    bool        payload_header;
+    uint64_t    lost;
+    uint64_t    reordered;
+    uint64_t    corrupted;
+
+    // The latency of the measurement window, in nanoseconds.
+    latency_histogram latency;
+    // The connect latency of the churn test, in nanoseconds.
+    latency_histogram connect_latency;
+
+    test_report()
+        : packet_size(0), max_packet_size(0), thread_num(0), conn_num(0), pipeline(0), target_rate(0.0), duration(0.0),
+          query_count(0), send_bytes(0), recv_bytes(0), connect_count(0), connections(0), errors(0),
+          payload_header(false), lost(0), reordered(0), corrupted(0)
+    {
+    }
+
+    double qps() const { return (duration > 0.0) ? (query_count / duration) : 0.0; }
+    double send_bandwidth() const { return (duration > 0.0) ? (send_bytes / duration / (1024.0 * 1024.0)) : 0.0; }
+    double recv_bandwidth() const { return (duration > 0.0) ? (recv_bytes / duration / (1024.0 * 1024.0)) : 0.0; }
+    double connect_rate() const { return (duration > 0.0) ? (connect_count / duration) : 0.0; }
+
+    /// format = "json" or "csv", the other formats are chosen by the file extension.
+    bool write(const std::string & filename, const std::string & format) const
+    {
+        bool is_csv = (format == "csv");
+        if (format != "json" && format != "csv") {
+            is_csv = (filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".csv") == 0);
+        }
+        return (is_csv ? write_csv(filename) : write_json(filename));
+    }
+
+    bool write_json(const std::string & filename) const
+    {
+        std::ofstream ofs(filename.c_str(), std::ios::out | std::ios::trunc);
+        if (!ofs.is_open())
+            return false;
+
+        ofs << std::setiosflags(std::ios::fixed) << std::setprecision(3);
+        ofs << "{" << std::endl
+            << "    \"host\": \"" << host.c_str() << "\"," << std::endl
+            << "    \"port\": " << port.c_str() << "," << std::endl
+            << "    \"mode\": \"" << mode.c_str() << "\"," << std::endl
+            << "    \"test\": \"" << method.c_str() << "\"," << std::endl
+            << "    \"protocol\": \"" << protocol.c_str() << "\"," << std::endl
+            << "    \"packet_size\": " << packet_size << "," << std::endl
+            << "    \"max_packet_size\": " << max_packet_size << "," << std::endl
+            << "    \"thread_num\": " << thread_num << "," << std::endl
+            << "    \"conn_num\": " << conn_num << "," << std::endl
+            << "    \"pipeline\": " << pipeline << "," << std::endl
+            << "    \"target_rate\": " << target_rate << "," << std::endl
+            << "    \"arrival\": \"" << arrival.c_str() << "\"," << std::endl
+            << "    \"duration_sec\": " << duration << "," << std::endl
+            << "    \"connections\": " << connections << "," << std::endl
+            << "    \"errors\": " << errors << "," << std::endl
+            << "    \"payload_header\": " << (payload_header ? "true" : "false") << "," << std::endl
+            << "    \"lost\": " << lost << "," << std::endl
+            << "    \"reordered\": " << reordered << "," << std::endl
+            << "    \"corrupted\": " << corrupted << "," << std::endl
+            << "    \"query_count\": " << query_count << "," << std::endl
+            << "    \"qps\": " << qps() << "," << std::endl
+            << "    \"send_bytes\": " << send_bytes << "," << std::endl
+            << "    \"recv_bytes\": " << recv_bytes << "," << std::endl
+            << "    \"send_mb_per_sec\": " << send_bandwidth() << "," << std::endl
+            << "    \"recv_mb_per_sec\": " << recv_bandwidth() << "," << std::endl
+            << "    \"latency_us\": {" << std::endl
+            << "        \"count\": " << latency.count() << "," << std::endl
+            << "        \"min\": " << (latency.min_value() / 1000.0) << "," << std::endl
+            << "        \"mean\": " << (latency.mean() / 1000.0) << "," << std::endl
+            << "        \"p50\": " << (latency.value_at_percentile(50.0) / 1000.0) << "," << std::endl
+            << "        \"p90\": " << (latency.value_at_percentile(90.0) / 1000.0) << "," << std::endl
+            << "        \"p99\": " << (latency.value_at_percentile(99.0) / 1000.0) << "," << std::endl
+            << "        \"p99.9\": " << (latency.value_at_percentile(99.9) / 1000.0) << "," << std::endl
+            << "        \"p99.99\": " << (latency.value_at_percentile(99.99) / 1000.0) << "," << std::endl
+            << "        \"max\": " << (latency.max_value() / 1000.0) << std::endl
+            << "    }," << std::endl
+            << "    \"connect_count\": " << connect_count << "," << std::endl
+            << "    \"conns_per_sec\": " << connect_rate() << "," << std::endl
+            << "    \"connect_latency_us\": {" << std::endl
+            << "        \"count\": " << connect_latency.count() << "," << std::endl
+            << "        \"mean\": " << (connect_latency.mean() / 1000.0) << "," << std::endl
+            << "        \"p50\": " << (connect_latency.value_at_percentile(50.0) / 1000.0) << "," << std::endl
+            << "        \"p90\": " << (connect_latency.value_at_percentile(90.0) / 1000.0) << "," << std::endl
+            << "        \"p99\": " << (connect_latency.value_at_percentile(99.0) / 1000.0) << "," << std::endl
+            << "        \"p99.9\": " << (connect_latency.value_at_percentile(99.9) / 1000.0) << "," << std::endl
+            << "        \"max\": " << (connect_latency.max_value() / 1000.0) << std::endl
+            << "    }" << std::endl
+            << "}" << std::endl;
+        return ofs.good();
+    }
+
+    bool write_csv(const std::string & filename) const
+    {
+        bool need_header = true;
+        {
+            std::ifstream ifs(filename.c_str(), std::ios::in | std::ios::binary);
+            if (ifs.is_open() && ifs.peek() != std::ifstream::traits_type::eof())
+                need_header = false;
+        }
+
+        std::ofstream ofs(filename.c_str(), std::ios::out | std::ios::app);
+        if (!ofs.is_open())
+            return false;
+
+        if (need_header) {
+            ofs << "host,port,mode,test,protocol,packet_size,max_packet_size,thread_num,conn_num,pipeline,target_rate,arrival,"
+                   "duration_sec,connections,errors,payload_header,lost,reordered,corrupted,query_count,qps,send_bytes,recv_bytes,"
+                   "send_mb_per_sec,recv_mb_per_sec,latency_count,latency_min_us,latency_mean_us,"
+                   "latency_p50_us,latency_p90_us,latency_p99_us,latency_p99.9_us,latency_p99.99_us,"
+                   "latency_max_us,connect_count,conns_per_sec,connect_p50_us,connect_p99_us,connect_p99.9_us,"
+                   "connect_max_us" << std::endl;
+        }
+
+        ofs << std::setiosflags(std::ios::fixed) << std::setprecision(3);
+        ofs << host.c_str() << "," << port.c_str() << "," << mode.c_str() << "," << method.c_str() << ","
+            << protocol.c_str() << "," << packet_size << "," << max_packet_size << "," << thread_num << "," << conn_num << "," << pipeline << ","
+            << target_rate << "," << arrival.c_str() << ","
+            << duration << "," << connections << "," << errors << ","
+            << (payload_header ? 1 : 0) << "," << lost << "," << reordered << "," << corrupted << ","
+            << query_count << "," << qps() << "," << send_bytes << "," << recv_bytes << ","
+            << send_bandwidth() << "," << recv_bandwidth() << ","
+            << latency.count() << ","
+            << (latency.min_value() / 1000.0) << ","
+            << (latency.mean() / 1000.0) << ","
+            << (latency.value_at_percentile(50.0) / 1000.0) << ","
+            << (latency.value_at_percentile(90.0) / 1000.0) << ","
+            << (latency.value_at_percentile(99.0) / 1000.0) << ","
+            << (latency.value_at_percentile(99.9) / 1000.0) << ","
+            << (latency.value_at_percentile(99.99) / 1000.0) << ","
+            << (latency.max_value() / 1000.0) << ","
+            << connect_count << "," << connect_rate() << ","
+            << (connect_latency.value_at_percentile(50.0) / 1000.0) << ","
+            << (connect_latency.value_at_percentile(99.0) / 1000.0) << ","
+            << (connect_latency.value_at_percentile(99.9) / 1000.0) << ","
+            << (connect_latency.max_value() / 1000.0) << std::endl;
+        return ofs.good();
+    }
+};
+
+} // namespace asio_test
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <functional>
+#include <boost/noncopyable.hpp>
+#include <boost/asio.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+namespace asio_test {
+
+//
+// The retry of the failed accepts of one acceptor.
+//
+// An accept failed by the lack of resources (EMFILE, ENFILE, ENOBUFS, ENOMEM) would fail
+// again at once, so it is re-armed after a delay instead, the delay is doubled by every
+// failed retry up to kMaxDelay and reset by the next accepted connection. The pending
+// connections stay in the listen backlog in the meantime. All of the accepts failed
+// during one delay are re-armed by the same timer.
+//
+// A connection aborted by its peer before it was accepted is not a failure of the
+// acceptor, the accept is re-armed at once.
+//
+// It is only used by the thread of the acceptor's io_service.
+//
+class accept_backoff : private boost::noncopyable {
+public:
+    typedef std::function<void ()> accept_handler;
+
+    static const uint32_t kMinDelay = 10;       // milliseconds
+    static const uint32_t kMaxDelay = 1000;     // milliseconds
+
+private:
+    boost::asio::steady_timer timer_;
+    uint32_t        delay_;
+    std::size_t     waiting_;
+
+public:
+    explicit accept_backoff(boost::asio::io_service & io_service)
+        : timer_(io_service), delay_(kMinDelay), waiting_(0)
+    {
+    }
+
+    ~accept_backoff() {}
+
+    /// Whether the accept can be re-armed at once after the error.
+    static bool is_retryable_now(const boost::system::error_code & ec)
+    {
+        return (ec == boost::asio::error::connection_aborted
+#if defined(EPROTO)
+             || ec == boost::system::error_code(EPROTO, boost::asio::error::get_system_category())
+#endif
+             || ec == boost::asio::error::try_again
+             || ec == boost::asio::error::would_block);
+    }
+
+    /// The accept succeeded, the next failure waits the min delay again.
+    void reset()
+    {
+        delay_ = kMinDelay;
+    }
+
+    uint32_t delay() const { return delay_; }
+
+    /// Re-arm the failed accept after the delay. Return true if it starts a new delay,
+    /// false if it joins the accepts already waiting.
+    bool defer(const accept_handler & accept)
+    {
+        ++waiting_;
+        if (waiting_ > 1)
+            return false;
+
+        timer_.expires_from_now(std::chrono::milliseconds(delay_));
+        timer_.async_wait(
+            [this, accept](const boost::system::error_code & ec)
+            {
+                std::size_t waiting = waiting_;
+                waiting_ = 0;
+                if (ec)
+                    return;
+
+                delay_ = (delay_ * 2 < kMaxDelay) ? (delay_ * 2) : kMaxDelay;
+                for (std::size_t i = 0; i < waiting; ++i) {
+                    accept();
+                }
+            });
+        return true;
+    }
+
+    void cancel()
+    {
+        boost::system::error_code ec;
+        timer_.cancel(ec);
+    }
+};
+
+} // namespace asio_test
@@ -11,17 +11,14 @@
 #include <boost/asio/basic_stream_socket.hpp>
 
 #include "common.h"
+#include "session_pool.hpp"
+#include "handler_allocator.hpp"
 
 using namespace boost::system;
 
 #define MIN_PACKET_SIZE             64
 #define MAX_PACKET_SIZE	            (64 * 1024)
 
-// Whether use atomic update realtime?
-#define USE_ATOMIC_REALTIME_UPDATE  0
-
-#define QUERY_COUNTER_INTERVAL      99
-
 using namespace boost::asio;
 
 namespace asio_test {
@@ -33,24 +30,46 @@ private:
 
     ip::tcp::socket socket_;
     uint32_t packet_size_;
-    uint64_t query_count_;
 
-    char data_[PACKET_SIZE];
+    session_pool<asio_connection> * pool_;
+
+    // The handler memory of the read and write operations.
+    handler_memory read_memory_;
+    handler_memory write_memory_;
+
+    // The sent bytes which are not counted as a query yet.
+    uint32_t send_bytes_remain_;
+
+    // The double buffers, data_size_[i] is the size of the received bytes waiting to be
+    // written back in data_[i], 0 means it's free to read into.
+    uint32_t read_index_;
+    uint32_t write_index_;
+    uint32_t data_size_[2];
+    bool     reading_;
+    bool     writing_;
+    bool     closing_;
+
+    // Needn't to fill them, the data is always recieved before it be echoed.
+    char data_[2][PACKET_SIZE];
 
 public:
-    asio_connection(boost::asio::io_service & io_service, uint32_t packet_size)
-        : socket_(io_service), packet_size_(packet_size), query_count_(0)
+    asio_connection(boost::asio::io_service & io_service, uint32_t packet_size,
+                    session_pool<asio_connection> * pool = nullptr)
+        : socket_(io_service), packet_size_(packet_size), pool_(pool), send_bytes_remain_(0),
+          read_index_(0), write_index_(0), reading_(false), writing_(false), closing_(false)
     {
-        ::memset(data_, 'k', sizeof(data_));
+        data_size_[0] = 0;
+        data_size_[1] = 0;
     }
 
     ~asio_connection()
     {
+        boost::system::error_code ec;
 #if !defined(_WIN32_WINNT) || (_WIN32_WINNT >= 0x0600)
-        socket_.cancel();
+        socket_.cancel(ec);
 #endif
         //socket_.shutdown(socket_base::shutdown_both);
-        socket_.close();
+        socket_.close(ec);
     }
 
     void start()
@@ -63,8 +82,29 @@ public:
     void stop(bool delete_self = false)
     {
         g_client_count--;
-        if (delete_self)
-            delete this;
+        if (delete_self) {
+            if (pool_)
+                pool_->release(this);
+            else
+                delete this;
+        }
+    }
+
+    /// Clear the state before the connection be recycled by the session pool.
+    void reset()
+    {
+        boost::system::error_code ec;
+        if (socket_.is_open())
+            socket_.close(ec);
+
+        send_bytes_remain_ = 0;
+        read_index_ = 0;
+        write_index_ = 0;
+        data_size_[0] = 0;
+        data_size_[1] = 0;
+        reading_ = false;
+        writing_ = false;
+        closing_ = false;
     }
 
     ip::tcp::socket & socket()
@@ -95,122 +135,118 @@ private:
         //std::cout << "set_socket_recv_buffer_size(): " << buffer_size << " bytes" << std::endl;
     }
 
-    inline void do_query_counter()
+    inline void do_recieve_counter(uint32_t bytes_recieved)
     {
-#if defined(USE_ATOMIC_REALTIME_UPDATE) && (USE_ATOMIC_REALTIME_UPDATE > 0)
-        g_query_count.fetch_add(1);
-#else
-        query_count_++;
-        if (query_count_ >= QUERY_COUNTER_INTERVAL) {
-            g_query_count.fetch_add(QUERY_COUNTER_INTERVAL);
-            query_count_ = 0;
+        if (bytes_recieved > 0) {
+            g_recv_bytes.add(bytes_recieved);
         }
-#endif
     }
 
-    void do_read()
+    inline void do_send_counter(uint32_t byte_sent)
     {
-        //auto self(this->shared_from_this());
-        boost::asio::async_read(socket_, boost::asio::buffer(data_, packet_size_),
-            [this](const boost::system::error_code & ec, std::size_t received_bytes)
-            {
-                if ((uint32_t)received_bytes != packet_size_) {
-                    std::cout << "asio_connection::do_read(): async_read(), received_bytes = "
-                              << received_bytes << " bytes." << std::endl;
-                }
-                if (!ec) {
-                    // A successful request, can be used to statistic qps
-                    do_write();
-                }
-                else {
-                    // Write error log
-                    std::cout << "asio_connection::do_read() - Error: (code = " << ec.value() << ") "
-                              << ec.message().c_str() << std::endl;
-                    stop(true);
-                }
-            }
-        );
+        if (byte_sent > 0) {
+            g_send_bytes.add(byte_sent);
+        }
     }
 
-    void do_write()
+    inline void do_query_counter_write_some(uint32_t send_bytes)
     {
-        //auto self(this->shared_from_this());
-        boost::asio::async_write(socket_, boost::asio::buffer(data_, packet_size_),
-            [this](const boost::system::error_code & ec, std::size_t bytes_written)
-            {
-                if (!ec) {
-                    // If get a circle of ping-pong, we count the query one time.
-                    do_query_counter();
-
-                    if ((uint32_t)bytes_written != packet_size_) {
-                        std::cout << "asio_connection::do_write(): async_write(), bytes_written = "
-                                  << bytes_written << " bytes." << std::endl;
-                    }
+        uint32_t delta_bytes = send_bytes_remain_ + send_bytes;
+        uint32_t delta_query_count = delta_bytes / packet_size_;
+        if (delta_query_count > 0) {
+            g_query_count.add(delta_query_count);
+        }
+        send_bytes_remain_ = delta_bytes - packet_size_ * delta_query_count;
+    }
 
-                    do_read();
-                }
-                else {
-                    // Write error log
-                    std::cout << "asio_connection::do_write() - Error: (code = " << ec.value() << ") "
-                              << ec.message().c_str() << std::endl;
-                    stop(true);
-                }
-            }
-        );
+    /// Close the socket to cancel the other pending operation, the connection is released
+    /// by the last completed operation, so no handler can run after it is recycled.
+    void close_and_release()
+    {
+        if (!closing_) {
+            closing_ = true;
+            boost::system::error_code ec;
+            socket_.close(ec);
+        }
+        if (!reading_ && !writing_)
+            stop(true);
     }
 
-    void do_read_some()
+    //
+    // The full-duplex echo: the socket is read into one buffer while the other one is
+    // being written back, the buffers are written in the order they were filled.
+    // When both of the buffers are waiting to be written, the read is paused until
+    // a write completes, so a slow reader of the echoes throttles its own sender.
+    //
+    void do_read()
     {
-        socket_.async_read_some(boost::asio::buffer(data_, packet_size_),
+        if (reading_ || closing_ || data_size_[read_index_] != 0)
+            return;
+
+        reading_ = true;
+        socket_.async_read_some(boost::asio::buffer(data_[read_index_], PACKET_SIZE),
+            make_custom_alloc_handler(read_memory_,
             [this](const boost::system::error_code & ec, std::size_t received_bytes)
             {
-                if ((uint32_t)received_bytes != packet_size_) {
-                    std::cout << "asio_connection::do_read_some(): async_read(), received_bytes = "
-                              << received_bytes << " bytes." << std::endl;
-                }
-                if (!ec) {
-                    // A successful request, can be used to statistic qps
-                    do_write_some();
+                reading_ = false;
+                if (!ec && !closing_) {
+                    // Count the recieved bytes
+                    do_recieve_counter((uint32_t)received_bytes);
+
+                    data_size_[read_index_] = (uint32_t)received_bytes;
+                    read_index_ ^= 1;
+
+                    do_write();
+                    do_read();
                 }
                 else {
-                    // Write error log
-                    std::cout << "asio_connection::do_read_some() - Error: (code = " << ec.value() << ") "
-                              << ec.message().c_str() << std::endl;
-                    stop(true);
+                    if (!closing_) {
+                        // Write error log
+                        std::cout << "asio_connection::do_read() - Error: (code = " << ec.value() << ") "
+                                  << ec.message().c_str() << std::endl;
+                    }
+                    close_and_release();
                 }
-            }
+            })
         );
     }
 
-    void do_write_some()
+    void do_write()
     {
-        //auto self(this->shared_from_this());
-        socket_.async_write_some(boost::asio::buffer(data_, packet_size_),
+        if (writing_ || closing_ || data_size_[write_index_] == 0)
+            return;
+
+        writing_ = true;
+        boost::asio::async_write(socket_, boost::asio::buffer(data_[write_index_], data_size_[write_index_]),
+            make_custom_alloc_handler(write_memory_,
             [this](const boost::system::error_code & ec, std::size_t bytes_written)
             {
-                if (!ec) {
+                writing_ = false;
+                if (!ec && !closing_) {
+                    // Count the sent bytes
+                    do_send_counter((uint32_t)bytes_written);
+
                     // If get a circle of ping-pong, we count the query one time.
-                    do_query_counter();
+                    do_query_counter_write_some((uint32_t)bytes_written);
 
-                    if ((uint32_t)bytes_written != packet_size_) {
-                        std::cout << "asio_connection::do_write_some(): async_write(), bytes_written = "
-                                  << bytes_written << " bytes." << std::endl;
-                    }
+                    data_size_[write_index_] = 0;
+                    write_index_ ^= 1;
 
-                    do_read_some();
+                    // Write the buffer filled during the write, and resume the read if both were full.
+                    do_write();
+                    do_read();
                 }
                 else {
-                    // Write error log
-                    std::cout << "asio_connection::do_write_some() - Error: (code = " << ec.value() << ") "
-                              << ec.message().c_str() << std::endl;
-                    stop(true);
+                    if (!closing_) {
+                        // Write error log
+                        std::cout << "asio_connection::do_write() - Error: (code = " << ec.value() << ") "
+                                  << ec.message().c_str() << std::endl;
+                    }
+                    close_and_release();
                 }
-            }
+            })
         );
     }
 };
 
 } // namespace asio_test
-
-#undef USE_ATOMIC_REALTIME_UPDATE
-#undef QUERY_COUNTER_INTERVAL
@@ -10,33 +10,98 @@
 
 #include "common.h"
 #include "common/cmd_utils.hpp"
+#include "common/process_stats.hpp"
+#include "cpu_affinity.hpp"
 #include "async_asio_echo_serv.hpp"
 #include "async_aiso_echo_serv_ex.hpp"
 #include "http_server/async_asio_http_server.hpp"
+#include "server_stats.hpp"
+#include "stats_server.hpp"
+#include "io_uring/io_uring_serv.hpp"
 
 uint32_t g_test_mode    = asio_test::test_mode_echo_server;
 uint32_t g_test_method  = asio_test::test_method_pingpong;
 uint32_t g_nodelay      = 0;
+uint32_t g_reuse_port   = 0;
+uint32_t g_numa_local   = 0;
+uint32_t g_session_pool_size = 256;
+uint32_t g_pending_accepts = 16;
 uint32_t g_need_echo    = 1;
 uint32_t g_packet_size  = 64;
+uint32_t g_protocol     = asio_test::protocol_raw;
+uint32_t g_sink_trunc   = 0;
+uint32_t g_engine       = asio_test::engine_asio;
+uint32_t g_busy_poll    = 0;
+uint32_t g_so_busy_poll = 0;
+uint32_t g_console_stats = 1;
 
 std::string g_test_mode_str      = "echo";
 std::string g_test_method_str    = "pingpong";
 std::string g_test_mode_full_str = "echo server";
 std::string g_nodelay_str        = "false";
+std::string g_reuse_port_str     = "false";
+std::string g_cpu_list_str       = "";
+std::string g_protocol_str       = "raw";
+std::string g_engine_str         = "asio";
+std::string g_stats_port;
 std::string g_rpc_topic;
 
 std::string g_server_ip;
 std::string g_server_port;
 
-asio_test::padding_atomic<uint64_t> asio_test::g_query_count(0);
+std::vector<int> g_cpu_list;
+std::vector<std::string> g_http_routes;
+
+asio_test::sharded_counter asio_test::g_query_count;
 asio_test::padding_atomic<uint32_t> asio_test::g_client_count(0);
 
-asio_test::padding_atomic<uint64_t> asio_test::g_recv_bytes(0);
-asio_test::padding_atomic<uint64_t> asio_test::g_send_bytes(0);
+asio_test::sharded_counter asio_test::g_recv_bytes;
+asio_test::sharded_counter asio_test::g_send_bytes;
+
+asio_test::padding_atomic<uint64_t> asio_test::g_handler_heap_allocs(0);
+
+asio_test::padding_atomic<uint64_t> asio_test::g_accept_count(0);
+asio_test::sharded_histogram asio_test::g_heartbeat_latency;
 
 using namespace asio_test;
 
+//
+// The connection costs of the server: the accept rate, the resident memory per connection
+// above the memory of the server without any connection, and the heartbeat latency of the
+// idle sessions (see g_heartbeat_latency).
+//
+void display_connection_stats(const server_stats & stats, uint64_t base_memory)
+{
+    const latency_histogram & heartbeat_latency = stats.heartbeat_latency;
+    std::cout << "    accepts/s = " << std::setw(7) << (uint64_t)stats.accepts_per_sec << ", "
+              << "RSS = " << std::setiosflags(std::ios::fixed) << std::setprecision(3)
+              << (stats.resident_memory / (1024.0 * 1024.0)) << " MB";
+    if (stats.connections > 0 && stats.resident_memory > base_memory) {
+        std::cout << " (" << ((stats.resident_memory - base_memory) / stats.connections) << " bytes/conn)";
+    }
+    if (heartbeat_latency.count() > 0) {
+        // The histogram values are in nanoseconds, display them in microseconds.
+        std::cout << ", heartbeat: p50 = " << (heartbeat_latency.value_at_percentile(50.0) / 1000.0)
+                  << ", p99 = " << (heartbeat_latency.value_at_percentile(99.0) / 1000.0)
+                  << ", max = " << (heartbeat_latency.max_value() / 1000.0)
+                  << " us, count = " << heartbeat_latency.count();
+    }
+    std::cout << std::endl;
+    std::cout << std::resetiosflags(std::ios::fixed);
+}
+
+/// Start the stats endpoint on g_stats_port, if it is set.
+bool start_stats_server(stats_server & server, const std::string & ip)
+{
+    if (g_stats_port.empty())
+        return false;
+    if (!server.start(ip, g_stats_port))
+        return false;
+    std::cout << "Stats endpoint: http://" << ip.c_str() << ":" << g_stats_port.c_str()
+              << "/stats (or /stats.json)" << std::endl;
+    return true;
+}
+
 void run_asio_echo_serv(const std::string & ip, const std::string & port,
                         uint32_t packet_size, uint32_t thread_num,
                         bool confirm = false)
@@ -97,26 +162,92 @@ void run_asio_echo_serv_ex(const std::string & ip, const std::string & port,
         }
         std::cout << std::endl;
 
-        uint64_t last_query_count = 0;
+        server_stats_sampler<async_asio_echo_serv_ex> sampler(server, ip, port, packet_size);
+        stats_server stats_endpoint;
+        bool has_stats_endpoint = start_stats_server(stats_endpoint, ip);
+
+        uint64_t base_memory = process_stats::resident_memory();
         while (true) {
-            auto cur_succeed_count = (uint64_t)g_query_count;
-            auto client_count = (uint32_t)g_client_count;
-            auto qps = (cur_succeed_count - last_query_count);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+
+            const server_stats & stats = sampler.sample();
+            if (has_stats_endpoint)
+                stats_endpoint.update(stats);
+            if (g_console_stats == 0)
+                continue;
+
             std::cout << ip.c_str() << ":" << port.c_str() << " - " << packet_size << " bytes : "
                       << thread_num << " threads : "
-                      << "[" << std::left << std::setw(4) << client_count << "] conns : "
+                      << "[" << std::left << std::setw(4) << stats.connections << "] conns : "
                       << "nodelay = " << g_nodelay << ", "
                       << "mode = " << g_test_mode_str.c_str() << ", "
                       << "test = " << g_test_method_str.c_str() << ", "
-                      << "qps = " << std::right << std::setw(7) << qps << ", "
+                      << "protocol = " << g_protocol_str.c_str() << ", "
+                      << "qps = " << std::right << std::setw(7) << (uint64_t)stats.qps << ", "
                       << "BandWidth = "
                       << std::right << std::setw(6)
                       << std::setiosflags(std::ios::fixed) << std::setprecision(3)
-                      << ((qps * packet_size) / (1024.0 * 1024.0))
-                      << " MB/s" << std::endl;
+                      << (stats.recv_bytes_per_sec / (1024.0 * 1024.0))
+                      << " MB/s, "
+                      << "pool hits/misses = " << stats.pool_hits
+                      << "/" << stats.pool_misses << ", "
+                      << "buffer allocs = " << stats.buffer_allocs << ", "
+                      << "handler heap allocs = " << stats.handler_heap_allocs << std::endl;
             std::cout << std::right;
-            last_query_count = cur_succeed_count;
+            display_connection_stats(stats, base_memory);
+        }
+
+        server.join();
+    }
+    catch (const std::exception & e) {
+        std::cerr << "Exception: " << e.what() << std::endl;
+    }
+}
+
+void run_asio_sink_serv(const std::string & ip, const std::string & port,
+                        uint32_t packet_size, uint32_t thread_num,
+                        bool confirm = false)
+{
+    static const uint32_t kSeesionBufferSize = 65536;
+    try {
+        async_asio_echo_serv_ex server(ip, port, kSeesionBufferSize, packet_size, thread_num);
+        server.run();
+
+        std::cout << "Sink Server has bind and listening ..." << std::endl;
+        std::cout << "MSG_TRUNC: " << ((g_sink_trunc != 0) ? "true" : "false") << std::endl;
+        if (confirm) {
+            std::cout << "press [enter] key to continue ...";
+            getchar();
+        }
+        std::cout << std::endl;
+
+        server_stats_sampler<async_asio_echo_serv_ex> sampler(server, ip, port, packet_size);
+        stats_server stats_endpoint;
+        bool has_stats_endpoint = start_stats_server(stats_endpoint, ip);
+
+        while (true) {
             std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+
+            // The ingest bandwidth is measured by the real elapsed time, not the 1 second sleep.
+            const server_stats & stats = sampler.sample();
+            if (has_stats_endpoint)
+                stats_endpoint.update(stats);
+            if (g_console_stats == 0)
+                continue;
+
+            std::cout << ip.c_str() << ":" << port.c_str() << " - " << packet_size << " bytes : "
+                      << thread_num << " threads : "
+                      << "[" << std::left << std::setw(4) << stats.connections << "] conns : "
+                      << "mode = " << g_test_mode_str.c_str() << ", "
+                      << "protocol = " << g_protocol_str.c_str() << ", "
+                      << "qps = " << std::right << std::setw(7) << (uint64_t)stats.qps << ", "
+                      << "Ingest BW = "
+                      << std::right << std::setw(9)
+                      << std::setiosflags(std::ios::fixed) << std::setprecision(3)
+                      << (stats.recv_bytes_per_sec / (1024.0 * 1024.0)) << " MB/s ("
+                      << (stats.recv_bytes_per_sec * 8.0 / 1E9) << " Gbit/s), "
+                      << "total = " << stats.recv_bytes << " bytes" << std::endl;
+            std::cout << std::right;
         }
 
         server.join();
@@ -136,42 +267,122 @@ void run_asio_http_server(const std::string & ip, const std::string & port,
         server.run();
 
         std::cout << "Http Server has bind and listening ..." << std::endl;
+        std::cout << "Http header scanner: " << http_scanner::kernel_name() << std::endl;
         if (confirm) {
             std::cout << "press [enter] key to continue ...";
             getchar();
         }
         std::cout << std::endl;
 
-        static const std::size_t response_html_size = g_response_html.size();
+        server_stats_sampler<async_asio_http_server> sampler(server, ip, port, packet_size);
+        stats_server stats_endpoint;
+        bool has_stats_endpoint = start_stats_server(stats_endpoint, ip);
 
-        uint64_t last_query_count = 0;
+        uint64_t base_memory = process_stats::resident_memory();
         while (true) {
-            auto cur_succeed_count = (uint64_t)g_query_count;
-            auto client_count = (uint32_t)g_client_count;
-            auto qps = (cur_succeed_count - last_query_count);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+
+            const server_stats & stats = sampler.sample();
+            if (has_stats_endpoint)
+                stats_endpoint.update(stats);
+            if (g_console_stats == 0)
+                continue;
+
             packet_size = g_packet_size;
             std::cout << ip.c_str() << ":" << port.c_str() << " - " << packet_size << " bytes : "
                       << thread_num << " threads : "
-                      << "[" << std::left << std::setw(4) << client_count << "] conns : "
+                      << "[" << std::left << std::setw(4) << stats.connections << "] conns : "
                       << "nodelay: " << g_nodelay << ", "
                       << "mode: " << g_test_mode_str.c_str() << ", "
                       << "test: " << g_test_method_str.c_str() << ", "
-                      << "qps = " << std::right << std::setw(7) << qps << ", "
+                      << "qps = " << std::right << std::setw(7) << (uint64_t)stats.qps << ", "
                       << "Recv BW: "
                       << std::right << std::setw(6)
                       << std::setiosflags(std::ios::fixed) << std::setprecision(3)
-                      << ((qps * packet_size) / (1024.0 * 1024.0))
+                      << ((stats.qps * packet_size) / (1024.0 * 1024.0))
                       << " MB/s, "
                       << "Send BW: "
                       << std::right << std::setw(6)
                       << std::setiosflags(std::ios::fixed) << std::setprecision(3)
-                      << ((qps * response_html_size) / (1024.0 * 1024.0))
-                      << " MB/s" << std::endl;
+                      << (stats.send_bytes_per_sec / (1024.0 * 1024.0))
+                      << " MB/s, "
+                      << "pool hits/misses = " << stats.pool_hits
+                      << "/" << stats.pool_misses << ", "
+                      << "buffer allocs = " << stats.buffer_allocs << ", "
+                      << "handler heap allocs = " << stats.handler_heap_allocs << std::endl;
             std::cout << std::right;
-            last_query_count = cur_succeed_count;
+            display_connection_stats(stats, base_memory);
+        }
+
+        server.join();
+    }
+    catch (const std::exception & e) {
+        std::cerr << "Exception: " << e.what() << std::endl;
+    }
+}
+
+#if HAS_IO_URING
+
+void run_io_uring_serv(const std::string & ip, const std::string & port,
+                       uint32_t packet_size, uint32_t thread_num,
+                       bool confirm = false)
+{
+    try {
+        io_uring_serv server(packet_size, thread_num);
+        if (!server.start(ip, port))
+            return;
+
+        std::cout << "io_uring Server has bind and listening ..." << std::endl;
+        if (confirm) {
+            std::cout << "press [enter] key to continue ...";
+            getchar();
+        }
+        std::cout << std::endl;
+
+        server_stats_sampler<io_uring_serv> sampler(server, ip, port, packet_size);
+        stats_server stats_endpoint;
+        bool has_stats_endpoint = start_stats_server(stats_endpoint, ip);
+
+        uint64_t last_enter_count = 0, last_cqe_count = 0;
+        while (!server.failed()) {
             std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+
+            const server_stats & stats = sampler.sample();
+            if (has_stats_endpoint)
+                stats_endpoint.update(stats);
+
+            auto cur_enter_count = server.enter_count();
+            auto cur_cqe_count = server.cqe_count();
+            auto enter_count = (cur_enter_count - last_enter_count);
+            auto cqe_count = (cur_cqe_count - last_cqe_count);
+            last_enter_count = cur_enter_count;
+            last_cqe_count = cur_cqe_count;
+            if (g_console_stats == 0)
+                continue;
+
+            std::cout << ip.c_str() << ":" << port.c_str() << " - " << packet_size << " bytes : "
+                      << thread_num << " threads : "
+                      << "[" << std::left << std::setw(4) << stats.connections << "] conns : "
+                      << "engine = io_uring, "
+                      << "mode = " << io_uring_serv::get_serv_mode_name(server.serv_mode()) << ", "
+                      << "qps = " << std::right << std::setw(7) << (uint64_t)stats.qps << ", "
+                      << "Recv BW = "
+                      << std::right << std::setw(6)
+                      << std::setiosflags(std::ios::fixed) << std::setprecision(3)
+                      << (stats.recv_bytes_per_sec / (1024.0 * 1024.0))
+                      << " MB/s, "
+                      << "Send BW = "
+                      << std::right << std::setw(6)
+                      << (stats.send_bytes_per_sec / (1024.0 * 1024.0))
+                      << " MB/s, "
+                      << "enters = " << enter_count << ", "
+                      << "cqes/enter = " << std::setprecision(2)
+                      << ((enter_count > 0) ? ((double)cqe_count / enter_count) : 0.0) << std::endl;
+            std::cout << std::right;
         }
 
+        std::cout << "io_uring Server has stopped by the error of a worker." << std::endl;
+        server.stop();
         server.join();
     }
     catch (const std::exception & e) {
@@ -179,6 +390,8 @@ void run_asio_http_server(const std::string & ip, const std::string & port,
     }
 }
 
+#endif // HAS_IO_URING
+
 void make_spaces(std::string & spaces, std::size_t size)
 {
     spaces = "";
@@ -197,6 +410,7 @@ void print_usage(const std::string & app_name, const boost::program_options::opt
     std::cerr << "Usage: " << std::endl << std::endl
               << "  " << app_name.c_str()      << " --host=<host> --port=<port> --mode=<mode> --test=<test>" << std::endl
               << "  " << leader_spaces.c_str() << " [--pipeline=1] [--packet_size=64] [--thread-num=0]" << std::endl
+              << "  " << leader_spaces.c_str() << " [--stats-port=9001] [--console=true]" << std::endl
               << std::endl
               << "For example: " << std::endl << std::endl
               << "  " << app_name.c_str()      << " --host=127.0.0.1 --port=9000 --mode=echo --test=pingpong" << std::endl
@@ -209,10 +423,13 @@ void print_usage(const std::string & app_name, const boost::program_options::opt
 int main(int argc, char * argv[])
 {
     std::string app_name;
-    std::string test_mode, test_method, nodelay, rpc_topic;
+    std::string test_mode, test_method, nodelay, reuse_port, cpu_list, numa_local, rpc_topic, protocol, sink_trunc, engine;
+    std::string stats_port, console_stats;
     std::string server_ip, server_port;
     std::string mode, test, cmd, cmd_value;
-    int32_t pipeline = 1, packet_size = 0, thread_num = 0, need_echo = 1;
+    int32_t pipeline = 1, packet_size = 0, thread_num = 0, need_echo = 1, session_pool_size = 256, pending_accepts = 16;
+    int32_t busy_poll = 0, so_busy_poll = 0;
+    std::vector<std::string> http_routes;
 
     namespace options = boost::program_options;
     options::options_description desc("Command list");
@@ -220,13 +437,26 @@ int main(int argc, char * argv[])
         ("help,h",                                                                                  "usage info")
         ("host,s",          options::value<std::string>(&server_ip)->default_value("127.0.0.1"),    "server host or ip address")
         ("port,p",          options::value<std::string>(&server_port)->default_value("9000"),       "server port")
-        ("mode,m",          options::value<std::string>(&test_mode)->default_value("echo"),         "test mode = [echo]")
+        ("mode,m",          options::value<std::string>(&test_mode)->default_value("echo"),         "test mode = [echo, no-echo, http]")
         ("test,t",          options::value<std::string>(&test_method)->default_value("pingpong"),   "test method = [pingpong, qps, latency, throughput]")
         ("pipeline,l",      options::value<int32_t>(&pipeline)->default_value(1),                   "pipeline numbers")
         ("packet-size,k",   options::value<int32_t>(&packet_size)->default_value(64),               "packet size")
         ("thread-num,n",    options::value<int32_t>(&thread_num)->default_value(0),                 "thread numbers")
         ("nodelay,y",       options::value<std::string>(&nodelay)->default_value("false"),          "TCP socket nodelay = [0 or 1, true or false]")
         ("echo,e",          options::value<int32_t>(&need_echo)->default_value(1),                  "whether the server need echo")
+        ("sink-trunc,d",    options::value<std::string>(&sink_trunc)->default_value("false"),       "no-echo server discards the data by recv(MSG_TRUNC) without copying = [0 or 1, true or false]")
+        ("protocol,f",      options::value<std::string>(&protocol)->default_value("raw"),           "echo protocol = [raw, framed], framed = length-prefixed frames (see echo_frame.hpp)")
+        ("engine,g",        options::value<std::string>(&engine)->default_value("asio"),            "io engine = [asio, io_uring], io_uring = multishot accept / recv with provided buffers (Linux 6.1+)")
+        ("busy-poll,b",     options::value<int32_t>(&busy_poll)->default_value(0),                  "microseconds the io threads spin on poll() before blocking, 0 = block in run()")
+        ("so-busy-poll,z",  options::value<int32_t>(&so_busy_poll)->default_value(0),               "SO_BUSY_POLL of the sessions (microseconds), 0 = off")
+        ("reuse-port,r",    options::value<std::string>(&reuse_port)->default_value("false"),       "one SO_REUSEPORT acceptor per io_service = [0 or 1, true or false]")
+        ("cpu-list,c",      options::value<std::string>(&cpu_list)->default_value(""),              "bind io_service threads to cpus = [all, physical, 0-3,8,...]")
+        ("session-pool,o",  options::value<int32_t>(&session_pool_size)->default_value(256),            "max recycled sessions per io_service")
+        ("pending-accepts,a", options::value<int32_t>(&pending_accepts)->default_value(16),           "async accepts kept pending on every acceptor")
+        ("numa,u",          options::value<std::string>(&numa_local)->default_value("false"),       "allocate thread memory on the local NUMA node = [0 or 1, true or false]")
+        ("stats-port,q",    options::value<std::string>(&stats_port)->default_value(""),            "serve the statistics as text (/stats) or JSON (/stats.json) on this port, empty = off")
+        ("console,v",       options::value<std::string>(&console_stats)->default_value("true"),     "display the statistics on the console every second = [0 or 1, true or false]")
+        ("http-route,w",    options::value< std::vector<std::string> >(&http_routes)->composing(),  "http route = \"path|status|content-type|body[|header: value]...\", body = @file to load from a file, path = * for any path")
         ;
 
     // parse command line
@@ -277,7 +507,7 @@ int main(int argc, char * argv[])
         g_test_mode_full_str = "http server";
     }
     else if (test_mode == "no-echo") {
-        g_test_mode = test_mode_echo_server;
+        g_test_mode = test_mode_no_echo_server;
         g_test_mode_str = test_mode;
         g_test_mode_full_str = "non-echo server";
     }
@@ -309,14 +539,58 @@ int main(int argc, char * argv[])
     }
     g_packet_size = packet_size;
 
+    // cpu-list
+    if (args_map.count("cpu-list") > 0) {
+        cpu_list = args_map["cpu-list"].as<std::string>();
+    }
+    g_cpu_list_str = cpu_list;
+    g_cpu_list.clear();
+    if (cpu_list == "all") {
+        get_logical_cpus(g_cpu_list);
+    }
+    else if (cpu_list == "physical") {
+        get_physical_cores(g_cpu_list);
+    }
+    else if (!cpu_list.empty()) {
+        if (!parse_cpu_list(cpu_list, g_cpu_list)) {
+            std::cerr << "Error: cpu list \"" << cpu_list.c_str() << "\" format is wrong, or a cpu is not less than "
+                      << kMaxCpuCount << "." << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        int offline_cpu = find_offline_cpu(g_cpu_list);
+        if (offline_cpu >= 0) {
+            std::cerr << "Error: cpu " << offline_cpu << " of the cpu list \"" << cpu_list.c_str()
+                      << "\" is not online." << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+    std::cout << "cpu-list: " << g_cpu_list_str.c_str() << " (" << g_cpu_list.size() << " cpus)" << std::endl;
+
+    // numa
+    if (args_map.count("numa") > 0) {
+        numa_local = args_map["numa"].as<std::string>();
+    }
+    g_numa_local = (numa_local == "1" || numa_local == "true") ? 1 : 0;
+    if (g_numa_local != 0 && g_cpu_list.empty()) {
+        std::cerr << "Warnning: --numa only takes effect with --cpu-list." << std::endl;
+    }
+    std::cout << "numa-local: " << g_numa_local << std::endl;
+
     // thread-num
     if (args_map.count("thread-num") > 0) {
         thread_num = args_map["thread-num"].as<int32_t>();
     }
     std::cout << "thread-num: " << thread_num << std::endl;
     if (thread_num <= 0) {
-        thread_num = std::thread::hardware_concurrency();
-        std::cout << ">>> thread-num: std::thread::hardware_concurrency() = " << thread_num << std::endl;
+        if (g_cpu_list.empty()) {
+            thread_num = std::thread::hardware_concurrency();
+            std::cout << ">>> thread-num: std::thread::hardware_concurrency() = " << thread_num << std::endl;
+        }
+        else {
+            // One io_service thread per cpu in the cpu list.
+            thread_num = (int32_t)g_cpu_list.size();
+            std::cout << ">>> thread-num: cpu-list size = " << thread_num << std::endl;
+        }
     }
 
     // nodelay
@@ -333,6 +607,20 @@ int main(int argc, char * argv[])
     }
     std::cout << "TCP scoket no-delay: " << g_nodelay_str.c_str() << std::endl;
 
+    // reuse-port
+    if (args_map.count("reuse-port") > 0) {
+        reuse_port = args_map["reuse-port"].as<std::string>();
+    }
+    if (reuse_port == "1" || reuse_port == "true") {
+        g_reuse_port = 1;
+        g_reuse_port_str = "true";
+    }
+    else {
+        g_reuse_port = 0;
+        g_reuse_port_str = "false";
+    }
+    std::cout << "SO_REUSEPORT acceptors: " << g_reuse_port_str.c_str() << std::endl;
+
     // need_echo
     need_echo = 1;
     if (args_map.count("echo") > 0) {
@@ -341,6 +629,137 @@ int main(int argc, char * argv[])
     std::cout << "need_echo: " << need_echo << std::endl;
     g_need_echo =  need_echo;
 
+    // sink-trunc
+    if (args_map.count("sink-trunc") > 0) {
+        sink_trunc = args_map["sink-trunc"].as<std::string>();
+    }
+    g_sink_trunc = (sink_trunc == "1" || sink_trunc == "true") ? 1 : 0;
+#if !defined(MSG_TRUNC) || !defined(__linux__)
+    if (g_sink_trunc != 0) {
+        std::cout << "Warning: MSG_TRUNC is not supported, the no-echo server copies the data." << std::endl;
+        g_sink_trunc = 0;
+    }
+#endif
+    if (g_test_mode == test_mode_no_echo_server)
+        std::cout << "sink-trunc: " << g_sink_trunc << std::endl;
+
+    // protocol
+    if (args_map.count("protocol") > 0) {
+        protocol = args_map["protocol"].as<std::string>();
+    }
+    if (protocol == "framed") {
+        g_protocol = protocol_framed;
+    }
+    else if (protocol == "raw") {
+        g_protocol = protocol_raw;
+    }
+    else {
+        std::cerr << "Error: Unknown protocol: [" << protocol.c_str() << "]." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    g_protocol_str = protocol;
+    std::cout << "protocol: " << g_protocol_str.c_str() << std::endl;
+
+    // engine
+    if (args_map.count("engine") > 0) {
+        engine = args_map["engine"].as<std::string>();
+    }
+    if (engine == "io_uring") {
+#if HAS_IO_URING
+        if (!io_uring_ring::is_supported()) {
+            std::cout << "Warning: io_uring is not available in this kernel, use the asio engine instead." << std::endl;
+            engine = "asio";
+        }
+        else if (g_protocol != protocol_raw && g_test_mode != test_mode_http_server) {
+            std::cerr << "Error: The io_uring engine only supports the raw protocol." << std::endl;
+            exit(EXIT_FAILURE);
+        }
+#else
+        std::cout << "Warning: io_uring is not supported, use the asio engine instead." << std::endl;
+        engine = "asio";
+#endif
+    }
+    else if (engine != "asio") {
+        std::cerr << "Error: Unknown engine: [" << engine.c_str() << "]." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    g_engine = (engine == "io_uring") ? engine_io_uring : engine_asio;
+    g_engine_str = engine;
+    std::cout << "engine: " << g_engine_str.c_str() << std::endl;
+
+    // busy-poll
+    if (args_map.count("busy-poll") > 0) {
+        busy_poll = args_map["busy-poll"].as<int32_t>();
+    }
+    g_busy_poll = (busy_poll > 0) ? (uint32_t)busy_poll : 0;
+    std::cout << "busy-poll: " << g_busy_poll << " us" << std::endl;
+
+    // so-busy-poll
+    if (args_map.count("so-busy-poll") > 0) {
+        so_busy_poll = args_map["so-busy-poll"].as<int32_t>();
+    }
+    g_so_busy_poll = (so_busy_poll > 0) ? (uint32_t)so_busy_poll : 0;
+#if !HAS_SOCKET_BUSY_POLL
+    if (g_so_busy_poll != 0) {
+        std::cout << "Warning: SO_BUSY_POLL is not supported." << std::endl;
+        g_so_busy_poll = 0;
+    }
+#endif
+    std::cout << "so-busy-poll: " << g_so_busy_poll << " us" << std::endl;
+
+    // session-pool
+    if (args_map.count("session-pool") > 0) {
+        session_pool_size = args_map["session-pool"].as<int32_t>();
+    }
+    if (session_pool_size < 0)
+        session_pool_size = 0;
+    g_session_pool_size = session_pool_size;
+    std::cout << "session-pool: " << g_session_pool_size << std::endl;
+
+    // pending-accepts
+    if (args_map.count("pending-accepts") > 0) {
+        pending_accepts = args_map["pending-accepts"].as<int32_t>();
+    }
+    if (pending_accepts < 1)
+        pending_accepts = 1;
+    g_pending_accepts = pending_accepts;
+    std::cout << "pending-accepts: " << g_pending_accepts << std::endl;
+
+    // stats-port
+    if (args_map.count("stats-port") > 0) {
+        stats_port = args_map["stats-port"].as<std::string>();
+    }
+    g_stats_port = stats_port;
+    if (!g_stats_port.empty())
+        std::cout << "stats-port: " << g_stats_port.c_str() << std::endl;
+
+    // console
+    if (args_map.count("console") > 0) {
+        console_stats = args_map["console"].as<std::string>();
+    }
+    g_console_stats = (console_stats == "0" || console_stats == "false") ? 0 : 1;
+    std::cout << "console: " << g_console_stats << std::endl;
+
+    // Every connection needs a file descriptor.
+    uint64_t open_files_limit = process_stats::raise_open_files_limit();
+    if (open_files_limit != 0)
+        std::cout << "open-files-limit: " << open_files_limit << std::endl;
+
+    // http-route
+    if (args_map.count("http-route") > 0) {
+        http_routes = args_map["http-route"].as< std::vector<std::string> >();
+    }
+    g_http_routes.clear();
+    for (std::size_t i = 0; i < http_routes.size(); ++i) {
+        http_response_table response_table;
+        if (!response_table.add_route(http_routes[i])) {
+            std::cerr << "Error: http route \"" << http_routes[i].c_str() << "\" format is wrong." << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        g_http_routes.push_back(http_routes[i]);
+        std::cout << "http-route: " << http_routes[i].c_str() << std::endl;
+    }
+
     // Run the server
     std::cout << std::endl;
     std::cout << app_name.c_str() << " begin ..." << std::endl;
@@ -349,14 +768,20 @@ int main(int argc, char * argv[])
     std::cout << "mode: " << g_test_mode_full_str.c_str() << std::endl;
     std::cout << "test: " << g_test_method_str.c_str() << std::endl;
     std::cout << "packet_size: " << packet_size << ", thread_num: " << thread_num << std::endl;
+    std::cout << "engine: " << g_engine_str.c_str() << std::endl;
     std::cout << std::endl;
 
+#if HAS_IO_URING
+    if (g_engine == engine_io_uring) {
+        run_io_uring_serv(server_ip, server_port, packet_size, thread_num);
+    }
+    else
+#endif
     if (g_test_mode == test_mode_http_server) {
         run_asio_http_server(server_ip, server_port, packet_size, thread_num);
     }
     else if (g_test_mode == test_mode_no_echo_server) {
-        // TODO:
-        std::cout << "TODO: test_mode_no_echo_server." << std::endl;
+        run_asio_sink_serv(server_ip, server_port, packet_size, thread_num);
     }
     else {
         //run_asio_echo_serv(server_ip, server_port, packet_size, thread_num);
@@ -1,33 +1,52 @@
 
 #pragma once
 
+#include <string.h>
 #include <iostream>
 #include <memory>
 #include <utility>
+#include <vector>
+#include <array>
 #include <atomic>
+#include <chrono>
 #include <boost/asio.hpp>
 #include <boost/system/error_code.hpp>
 #include <boost/smart_ptr.hpp>
 
 #include "common.h"
+#include "session_pool.hpp"
+#include "handler_allocator.hpp"
+#include "socket_options.hpp"
+#include "common/echo_frame.hpp"
 
 using namespace boost::system;
 
 #define MIN_PACKET_SIZE             64
 #define MAX_PACKET_SIZE	            (64 * 1024)
 
-// Whether use atomic update realtime?
-#define USE_ATOMIC_REALTIME_UPDATE  0
-
-#define QUERY_COUNTER_INTERVAL      99
-
-#define MAX_UPDATE_CNT              5
-#define MAX_UPDATE_BYTES            32768
-
 using namespace boost::asio;
 
 namespace asio_test {
 
+//
+// The receive buffer of a session. It is only held while the session has bytes in flight,
+// an idle session waits for the readability without any buffer and gives it back to the
+// buffer pool of its io_service, so an idle connection costs only the session itself.
+// The handler memory of the reads and writes goes with it, they only run while it is held.
+//
+struct session_buffer {
+    char data[MAX_PACKET_SIZE];
+
+    handler_memory read_memory;
+    handler_memory write_memory;
+
+    // Needn't to zero it, the data is always recieved before it be echoed.
+    session_buffer() {}
+    void reset() {}
+};
+
+typedef session_pool<session_buffer> session_buffer_pool;
+
 class asio_session : public boost::enable_shared_from_this<asio_session>,
                      private boost::noncopyable {
 private:
@@ -37,48 +56,92 @@ private:
     uint32_t    need_echo_;
     uint32_t    buffer_size_;
     uint32_t    packet_size_;
-    uint64_t    query_count_;
-
-    uint32_t    recieved_bytes_;
-    uint32_t    send_bytes_;
-
-    uint32_t    recieved_cnt_;
-    uint32_t    sent_cnt_;
-
     uint32_t    send_bytes_remain_;
     uint32_t    recieved_bytes_remain_;
-
-    char data_[PACKET_SIZE];
+    // The flags of the reads, MSG_TRUNC lets the no-echo session discard the data in the kernel.
+    int         recv_flags_;
+
+    // The echo ring of data_: the received bytes in [ring_head_, ring_head_ + ring_size_)
+    // (mod buffer_size_) are waiting to be echoed, the free bytes after them are read.
+    // At most one read and one write are pending at the same time.
+    uint32_t    ring_head_;
+    uint32_t    ring_size_;
+    bool        reading_;
+    bool        writing_;
+    bool        closing_;
+    std::array<boost::asio::mutable_buffer, 2> read_buffers_;
+    std::array<boost::asio::const_buffer, 2>   write_buffers_;
+
+    // The framed protocol: the bytes buffered in data_, and the frames to echo
+    // (offset, size) in them, the adjacent frames are merged.
+    uint32_t    protocol_;
+    uint32_t    recv_length_;
+    uint32_t    frames_consumed_;
+    std::vector< std::pair<uint32_t, uint32_t> > echo_frames_;
+    std::vector<boost::asio::const_buffer> echo_buffers_;
+
+    session_pool<asio_session> * pool_;
+
+    // The receive buffer, data_ is null while the session is idle. If the last read drained
+    // the socket, the next read waits for the readability first (see do_wait_read()).
+    session_buffer_pool * buffer_pool_;
+    session_buffer * buffer_;
+    char *      data_;
+    bool        read_waiting_;
+    bool        recv_drained_;
+
+    // When the idle session woke up, the heartbeat is done when its echo is written.
+    bool        heartbeat_;
+    std::chrono::steady_clock::time_point wake_time_;
+
+    // The handler memory of the wait and the first read dispatch, they run without a buffer,
+    // the reads and writes use the handler memory of the buffer.
+    wait_handler_memory wait_memory_;
 
 public:
     asio_session(boost::asio::io_service & io_service, uint32_t buffer_size,
-                 uint32_t packet_size, uint32_t need_echo = mode_need_echo)
+                 uint32_t packet_size, uint32_t need_echo = mode_need_echo,
+                 uint32_t protocol = protocol_raw,
+                 session_pool<asio_session> * pool = nullptr,
+                 session_buffer_pool * buffer_pool = nullptr)
         : socket_(io_service), need_echo_(need_echo), buffer_size_(buffer_size), packet_size_(packet_size),
-          query_count_(0), recieved_bytes_(0), send_bytes_(0), recieved_cnt_(0), sent_cnt_(0),
-          send_bytes_remain_(0), recieved_bytes_remain_(0)
+          send_bytes_remain_(0), recieved_bytes_remain_(0), recv_flags_(0), ring_head_(0), ring_size_(0),
+          reading_(false), writing_(false), closing_(false), protocol_(protocol), recv_length_(0),
+          frames_consumed_(0), pool_(pool), buffer_pool_(buffer_pool), buffer_(nullptr), data_(nullptr),
+          read_waiting_(false), recv_drained_(false), heartbeat_(false)
     {
         if (buffer_size_ > MAX_PACKET_SIZE)
             buffer_size_ = MAX_PACKET_SIZE;
         if (packet_size_ > MAX_PACKET_SIZE)
             packet_size_ = MAX_PACKET_SIZE;
-        ::memset(data_, 0, sizeof(data_));
     }
 
     ~asio_session()
     {
+        boost::system::error_code ec;
 #if !defined(_WIN32_WINNT) || (_WIN32_WINNT >= 0x0600)
-        socket_.cancel();
+        socket_.cancel(ec);
 #endif
         //socket_.shutdown(socket_base::shutdown_both);
         if (socket_.is_open())
-            socket_.close();
+            socket_.close(ec);
+        delete buffer_;
     }
 
     void start()
     {
         g_client_count++;
-        set_socket_send_bufsize(MAX_PACKET_SIZE);
-        set_socket_recv_bufsize(MAX_PACKET_SIZE);
+        if (need_echo_ == mode_no_echo) {
+            // The sink keeps the default buffer sizes, so the kernel can auto-tune the receive window.
+#if defined(MSG_TRUNC) && defined(__linux__)
+            // On Linux, the TCP recv() with MSG_TRUNC discards the data without copying it.
+            recv_flags_ = (g_sink_trunc != 0 && protocol_ == protocol_raw) ? MSG_TRUNC : 0;
+#endif
+        }
+        else {
+            set_socket_send_bufsize(MAX_PACKET_SIZE);
+            set_socket_recv_bufsize(MAX_PACKET_SIZE);
+        }
 
         static const int kNetSendTimeout = 45 * 1000;    // Send timeout is 45 seconds.
         static const int kNetRecvTimeout = 45 * 1000;    // Recieve timeout is 45 seconds.
@@ -90,14 +153,62 @@ public:
         sLinger.l_linger = 5;   // After shutdown(), socket send/recv 5 second data yet.
         ::setsockopt(socket_.native_handle(), SOL_SOCKET, SO_LINGER, (const char *)&sLinger, sizeof(sLinger));
 
-        do_read_some();
+#if HAS_SOCKET_BUSY_POLL
+        if (g_so_busy_poll != 0) {
+            // Raising it above net.core.busy_read needs CAP_NET_ADMIN, the error is ignored.
+            boost::system::error_code ec;
+            socket_.set_option(busy_poll((int)g_so_busy_poll), ec);
+        }
+#endif
+
+        // The new session waits for its first request without a buffer too. The socket can only
+        // be checked before a wait in the thread of the io_service (see do_wait_read()), so the
+        // first read is dispatched to it, it runs at once if the session is accepted in its own thread.
+#if (BOOST_VERSION >= 106600)
+        boost::asio::dispatch(socket_.get_executor(),
+#else
+        socket_.get_io_service().dispatch(
+#endif
+            make_custom_alloc_handler(wait_memory_,
+            [this]()
+            {
+                do_first_read();
+            })
+        );
     }
 
     void stop(bool delete_self = false)
     {
         g_client_count--;
-        if (delete_self)
-            delete this;
+        if (delete_self) {
+            if (pool_)
+                pool_->release(this);
+            else
+                delete this;
+        }
+    }
+
+    /// Clear the state before the session be recycled by the session pool.
+    void reset()
+    {
+        boost::system::error_code ec;
+        if (socket_.is_open())
+            socket_.close(ec);
+
+        send_bytes_remain_ = 0;
+        recieved_bytes_remain_ = 0;
+        recv_flags_ = 0;
+        ring_head_ = 0;
+        ring_size_ = 0;
+        reading_ = false;
+        writing_ = false;
+        closing_ = false;
+        recv_length_ = 0;
+        frames_consumed_ = 0;
+        read_waiting_ = false;
+        recv_drained_ = false;
+        heartbeat_ = false;
+        release_buffer();
     }
 
     ip::tcp::socket & socket()
@@ -107,7 +218,7 @@ public:
 
     static boost::shared_ptr<asio_session> create_new(
         boost::asio::io_service & io_service, uint32_t buffer_size, uint32_t packet_size) {
-        return boost::shared_ptr<asio_session>(new asio_session(io_service, buffer_size, packet_size, g_test_mode));
+        return boost::shared_ptr<asio_session>(new asio_session(io_service, buffer_size, packet_size, get_echo_session_mode(), g_protocol));
     }
 
 private:
@@ -122,7 +233,7 @@ private:
 
     void set_socket_send_bufsize(int buffer_size)
     {
-        boost::asio::socket_base::receive_buffer_size send_bufsize_option(buffer_size);
+        boost::asio::socket_base::send_buffer_size send_bufsize_option(buffer_size);
         socket_.set_option(send_bufsize_option);
 
         //std::cout << "set_socket_send_buffer_size(): " << buffer_size << " bytes" << std::endl;
@@ -145,105 +256,91 @@ private:
         //std::cout << "set_socket_recv_buffer_size(): " << buffer_size << " bytes" << std::endl;
     }
 
-    inline void do_recieve_counter(uint32_t bytes_recieved)
+    void do_first_read()
     {
-#if defined(USE_ATOMIC_REALTIME_UPDATE) && (USE_ATOMIC_REALTIME_UPDATE > 0)
-        if (bytes_recieved > 0) {
-            g_recv_bytes.fetch_add(bytes_recieved);
+        // do_wait_read() checks the socket, and reads at once if the request is already here.
+        recv_drained_ = true;
+        if (protocol_ == protocol_framed)
+            do_read_frames();
+        else
+            do_read_some();
+    }
+
+    void acquire_buffer()
+    {
+        if (buffer_ == nullptr) {
+            if (buffer_pool_ != nullptr)
+                buffer_ = buffer_pool_->acquire();
+            else
+                buffer_ = new session_buffer;
+            data_ = buffer_->data;
         }
-#else
+    }
+
+    void release_buffer()
+    {
+        // Without a buffer pool, the session keeps its buffer until it is deleted.
+        if (buffer_ != nullptr && buffer_pool_ != nullptr) {
+            buffer_pool_->release(buffer_);
+            buffer_ = nullptr;
+            data_ = nullptr;
+            ring_head_ = 0;
+        }
+    }
+
+    inline void do_heartbeat_counter()
+    {
+        if (heartbeat_) {
+            heartbeat_ = false;
+            g_heartbeat_latency.record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                       std::chrono::steady_clock::now() - wake_time_).count());
+        }
+    }
+
+    inline void do_recieve_counter(uint32_t bytes_recieved)
+    {
         if (bytes_recieved > 0) {
-            recieved_bytes_ += bytes_recieved;
-            recieved_cnt_++;
-            if (recieved_cnt_ >= MAX_UPDATE_CNT || recieved_bytes_ >= MAX_UPDATE_BYTES) {
-                g_recv_bytes.fetch_add(recieved_bytes_);
-                recieved_bytes_ = 0;
-                recieved_cnt_ = 0;
-            }
+            g_recv_bytes.add(bytes_recieved);
         }
-#endif
     }
 
     inline void do_send_counter(uint32_t byte_sent)
     {
-#if defined(USE_ATOMIC_REALTIME_UPDATE) && (USE_ATOMIC_REALTIME_UPDATE > 0)
         if (byte_sent > 0) {
-            g_send_bytes.fetch_add(byte_sent);
+            g_send_bytes.add(byte_sent);
         }
-#else
-        if (byte_sent > 0) {
-            send_bytes_ += byte_sent;
-            sent_cnt_++;
-            if (sent_cnt_ >= MAX_UPDATE_CNT || send_bytes_ >= MAX_UPDATE_BYTES) {
-                g_send_bytes.fetch_add(send_bytes_);
-                send_bytes_ = 0;
-                sent_cnt_ = 0;
-            }
-        }
-#endif
     }
 
     inline void do_query_counter()
     {
-#if defined(USE_ATOMIC_REALTIME_UPDATE) && (USE_ATOMIC_REALTIME_UPDATE > 0)
-        g_query_count.fetch_add(1);
-#else
-        query_count_++;
-        if (query_count_ >= QUERY_COUNTER_INTERVAL) {
-            g_query_count.fetch_add(QUERY_COUNTER_INTERVAL);
-            query_count_ = 0;
-        }
-#endif
+        g_query_count.add(1);
     }
 
     inline void do_query_counter_read_some(uint32_t recieved_bytes)
     {
         uint32_t delta_bytes = recieved_bytes_remain_ + recieved_bytes;
-        if (delta_bytes >= packet_size_) {
-            uint32_t delta_query_count = delta_bytes / packet_size_;
-#if defined(USE_ATOMIC_REALTIME_UPDATE) && (USE_ATOMIC_REALTIME_UPDATE > 0)
-            if (delta_query_count > 0) {
-                g_query_count.fetch_add(delta_query_count);
-                recieved_bytes_remain_ = delta_bytes - packet_size_ * delta_query_count;
-                return;
-            }
-#else
-            if (delta_query_count >= QUERY_COUNTER_INTERVAL) {
-                g_query_count.fetch_add(delta_query_count);
-                recieved_bytes_remain_ = delta_bytes - packet_size_ * delta_query_count;
-                return;
-            }
-#endif
+        uint32_t delta_query_count = delta_bytes / packet_size_;
+        if (delta_query_count > 0) {
+            g_query_count.add(delta_query_count);
         }
-        recieved_bytes_remain_ = delta_bytes;
+        recieved_bytes_remain_ = delta_bytes - packet_size_ * delta_query_count;
     }
 
     inline void do_query_counter_write_some(uint32_t send_bytes)
     {
         uint32_t delta_bytes = send_bytes_remain_ + send_bytes;
-        if (delta_bytes >= packet_size_) {
-            uint32_t delta_query_count = delta_bytes / packet_size_;
-#if defined(USE_ATOMIC_REALTIME_UPDATE) && (USE_ATOMIC_REALTIME_UPDATE > 0)
-            if (delta_query_count > 0) {
-                g_query_count.fetch_add(delta_query_count);
-                send_bytes_remain_ = delta_bytes - packet_size_ * delta_query_count;
-                return;
-            }
-#else
-            if (delta_query_count >= QUERY_COUNTER_INTERVAL) {
-                g_query_count.fetch_add(delta_query_count);
-                send_bytes_remain_ = delta_bytes - packet_size_ * delta_query_count;
-                return;
-            }
-#endif
+        uint32_t delta_query_count = delta_bytes / packet_size_;
+        if (delta_query_count > 0) {
+            g_query_count.add(delta_query_count);
         }
-        send_bytes_remain_ = delta_bytes;
+        send_bytes_remain_ = delta_bytes - packet_size_ * delta_query_count;
     }
 
     void do_read()
     {
         //auto self(this->shared_from_this());
         boost::asio::async_read(socket_, boost::asio::buffer(data_, packet_size_),
+            make_custom_alloc_handler(buffer_->read_memory,
             [this](const boost::system::error_code & ec, std::size_t received_bytes)
             {
                 if ((uint32_t)received_bytes != packet_size_) {
@@ -263,7 +360,7 @@ private:
                               << ec.message().c_str() << std::endl;
                     stop(true);
                 }
-            }
+            })
         );
     }
 
@@ -271,6 +368,7 @@ private:
     {
         //auto self(this->shared_from_this());
         boost::asio::async_write(socket_, boost::asio::buffer(data_, packet_size_),
+            make_custom_alloc_handler(buffer_->write_memory,
             [this](const boost::system::error_code & ec, std::size_t send_bytes)
             {
                 if (!ec) {
@@ -293,15 +391,128 @@ private:
                               << ec.message().c_str() << std::endl;
                     stop(true);
                 }
-            }
+            })
         );
     }
 
+    /// Close the socket to cancel the other pending operation, the session is released
+    /// by the last completed operation, so no handler can run after it is recycled.
+    void close_and_release()
+    {
+        if (!closing_) {
+            closing_ = true;
+            boost::system::error_code ec;
+            socket_.close(ec);
+        }
+        if (!reading_ && !writing_)
+            stop(true);
+    }
+
+    //
+    // Wait until the socket is readable without a read buffer, it is used when the last read
+    // has drained the socket. The buffer is given back to the pool if nothing is buffered,
+    // or later by the write which sends the last queued bytes.
+    //
+    // The sockets are edge-triggered in the epoll reactor, and a wait operation is never
+    // tried speculatively. A short read doesn't make the wait safe: the reactor may consume
+    // the edge of the data which arrives after the read, before the wait is queued. So the
+    // socket is checked again right before the wait, in the thread of the io_service where
+    // no epoll_wait() can run in between, and the session only parks if it is still drained.
+    //
+    void do_wait_read()
+    {
+        if (!is_socket_drained(socket_)) {
+            // The data (or the eof) is already here, read it at once.
+            recv_drained_ = false;
+            if (protocol_ == protocol_framed)
+                do_read_frames();
+            else
+                do_read_some();
+            return;
+        }
+
+        if (ring_size_ == 0 && recv_length_ == 0 && !writing_)
+            release_buffer();
+
+        reading_ = true;
+        read_waiting_ = true;
+#if (BOOST_VERSION >= 106600)
+        socket_.async_wait(ip::tcp::socket::wait_read,
+            make_custom_alloc_handler(wait_memory_,
+            [this](const boost::system::error_code & ec)
+            {
+                handle_wait_read(ec);
+            })
+        );
+#else
+        socket_.async_read_some(boost::asio::null_buffers(),
+            make_custom_alloc_handler(wait_memory_,
+            [this](const boost::system::error_code & ec, std::size_t /* received_bytes */)
+            {
+                handle_wait_read(ec);
+            })
+        );
+#endif
+    }
+
+    void handle_wait_read(const boost::system::error_code & ec)
+    {
+        reading_ = false;
+        read_waiting_ = false;
+        if (!ec && !closing_) {
+            recv_drained_ = false;
+            if (need_echo_ != mode_no_echo && !heartbeat_) {
+                heartbeat_ = true;
+                wake_time_ = std::chrono::steady_clock::now();
+            }
+            if (protocol_ == protocol_framed)
+                do_read_frames();
+            else
+                do_read_some();
+        }
+        else {
+            if (!closing_) {
+                // Write error log
+                std::cout << "asio_session::do_wait_read() - Error: (code = " << ec.value() << ") "
+                          << ec.message().c_str() << std::endl;
+            }
+            close_and_release();
+        }
+    }
+
     void do_read_some()
     {
-        socket_.async_read_some(boost::asio::buffer(data_, buffer_size_),
-            [this](const boost::system::error_code & ec, std::size_t received_bytes)
+        if (reading_ || closing_)
+            return;
+
+        if (recv_drained_) {
+            do_wait_read();
+            return;
+        }
+
+        uint32_t free_size = buffer_size_ - ring_size_;
+        if (free_size == 0)
+            return;
+
+        acquire_buffer();
+
+        // The free space of the ring, it may wrap around the end of data_.
+        uint32_t tail = ring_head_ + ring_size_;
+        if (tail >= buffer_size_)
+            tail -= buffer_size_;
+        uint32_t first_size = buffer_size_ - tail;
+        if (first_size > free_size)
+            first_size = free_size;
+        read_buffers_[0] = boost::asio::buffer(data_ + tail, first_size);
+        read_buffers_[1] = boost::asio::buffer(data_, free_size - first_size);
+
+        reading_ = true;
+        socket_.async_receive(read_buffers_, recv_flags_,
+            make_custom_alloc_handler(buffer_->read_memory,
+            [this, free_size](const boost::system::error_code & ec, std::size_t received_bytes)
             {
+                reading_ = false;
+                recv_drained_ = ((uint32_t)received_bytes < free_size);
 #if 0
                 static int cnt = 0, cnt_sm = 0, cnt_big = 0;
                 if ((uint32_t)received_bytes == packet_size_) {
@@ -338,105 +549,204 @@ private:
                     cnt++;
                 }
 #endif
-                if (!ec) {
+                if (!ec && !closing_) {
                     // Count the recieved bytes
                     do_recieve_counter((uint32_t)received_bytes);
 
                     if (need_echo_ == mode_no_echo) {
                         // Counter the recieved qps
                         do_query_counter_read_some((int32_t)received_bytes);
-
-                        // Needn't respond the request and read data again.
-                        do_read_some();
                     }
                     else {
-                        // A successful request, can be used to statistic qps.
-                        do_write_some((int32_t)received_bytes);
+                        // Queue the recieved bytes to echo, the write overlaps the next read.
+                        ring_size_ += (uint32_t)received_bytes;
+                        do_write_some();
                     }
+                    do_read_some();
                 }
                 else {
-                    // Write error log
-                    std::cout << "asio_session::do_read_some() - Error: (code = " << ec.value() << ") "
-                              << ec.message().c_str() << std::endl;
-                    stop(true);
+                    // The peer closing the connection is the normal end of a session.
+                    if (!closing_ && ec != boost::asio::error::eof) {
+                        // Write error log
+                        std::cout << "asio_session::do_read_some() - Error: (code = " << ec.value() << ") "
+                                  << ec.message().c_str() << std::endl;
+                    }
+                    close_and_release();
                 }
-            }
+            })
         );
     }
 
-    void do_write_some(int32_t total_send_bytes)
+    void do_write_some()
     {
-        //auto self(this->shared_from_this());
-        while (total_send_bytes > 0) {
-            std::size_t buffer_size;
-            if (total_send_bytes < PACKET_SIZE)
-                buffer_size = total_send_bytes;
-            else
-                buffer_size = PACKET_SIZE;
-#if 1
-            // async write one time <= PACKET_SIZE
-            boost::asio::async_write(socket_, boost::asio::buffer(data_, buffer_size),
-                [this, buffer_size](const boost::system::error_code & ec, std::size_t send_bytes)
-                {
-                    if (!ec) {
-                        // Count the sent bytes
-                        do_send_counter((uint32_t)send_bytes);
-
-                        // If get a circle of ping-pong, we count the query one time.
-                        do_query_counter_write_some((uint32_t)send_bytes);
-
-                        if ((uint32_t)send_bytes != buffer_size) {
-                            std::cout << "asio_session::do_write_some(): async_write(), send_bytes = "
-                                      << send_bytes << " bytes." << std::endl;
-                        }
-
-                        do_read_some();
+        if (writing_ || closing_ || ring_size_ == 0)
+            return;
+
+        // All of the queued bytes are sent by one gather write, in the order of the ring.
+        uint32_t first_size = buffer_size_ - ring_head_;
+        if (first_size > ring_size_)
+            first_size = ring_size_;
+        write_buffers_[0] = boost::asio::buffer(data_ + ring_head_, first_size);
+        write_buffers_[1] = boost::asio::buffer(data_, ring_size_ - first_size);
+
+        writing_ = true;
+        boost::asio::async_write(socket_, write_buffers_,
+            make_custom_alloc_handler(buffer_->write_memory,
+            [this](const boost::system::error_code & ec, std::size_t send_bytes)
+            {
+                writing_ = false;
+                if (!ec && !closing_) {
+                    // Count the sent bytes
+                    do_send_counter((uint32_t)send_bytes);
+
+                    // If get a circle of ping-pong, we count the query one time.
+                    do_query_counter_write_some((uint32_t)send_bytes);
+
+                    ring_head_ += (uint32_t)send_bytes;
+                    if (ring_head_ >= buffer_size_)
+                        ring_head_ -= buffer_size_;
+                    ring_size_ -= (uint32_t)send_bytes;
+
+                    if (ring_size_ == 0) {
+                        do_heartbeat_counter();
+
+                        // The echo is done and the session is waiting for more data, it needn't the buffer.
+                        if (read_waiting_)
+                            release_buffer();
                     }
-                    else {
+
+                    // Send the bytes recieved during the write, and resume the read if the ring was full.
+                    do_write_some();
+                    do_read_some();
+                }
+                else {
+                    if (!closing_) {
                         // Write error log
                         std::cout << "asio_session::do_write_some() - Error: (code = " << ec.value() << ") "
                                   << ec.message().c_str() << std::endl;
-                        stop(true);
                     }
+                    close_and_release();
                 }
-            );
-#else
-            // async write some one time <= PACKET_SIZE
-            socket_.async_write_some(boost::asio::buffer(data_, buffer_size),
-                [this, buffer_size](const boost::system::error_code & ec, std::size_t send_bytes)
-                {
-                    if (!ec) {
-                        // Count the sent bytes
-                        do_send_counter((uint32_t)send_bytes);
-
-                        // If get a circle of ping-pong, we count the query one time.
-                        do_query_counter_write_some((uint32_t)send_bytes);
-
-                        if ((uint32_t)send_bytes != buffer_size) {
-                            std::cout << "asio_session::do_write_some(): async_write(), send_bytes = "
-                                      << send_bytes << " bytes." << std::endl;
-                        }
-
-                        do_read_some();
-                    }
-                    else {
+            })
+        );
+    }
+
+    //
+    // The framed protocol: the frames are parsed incrementally from data_, all of the
+    // complete frames of a read are echoed by one gather write, and the incomplete
+    // frame at the end is moved to the front of data_ for the next read.
+    //
+    void do_read_frames()
+    {
+        if (recv_drained_) {
+            do_wait_read();
+            return;
+        }
+
+        acquire_buffer();
+        uint32_t free_size = buffer_size_ - recv_length_;
+        socket_.async_read_some(boost::asio::buffer(data_ + recv_length_, free_size),
+            make_custom_alloc_handler(buffer_->read_memory,
+            [this, free_size](const boost::system::error_code & ec, std::size_t received_bytes)
+            {
+                recv_drained_ = ((uint32_t)received_bytes < free_size);
+                if (!ec) {
+                    // Count the recieved bytes
+                    do_recieve_counter((uint32_t)received_bytes);
+
+                    recv_length_ += (uint32_t)received_bytes;
+                    handle_frames();
+                }
+                else {
+                    if (ec != boost::asio::error::eof) {
                         // Write error log
-                        std::cout << "asio_session::do_write() - Error: (code = " << ec.value() << ") "
+                        std::cout << "asio_session::do_read_frames() - Error: (code = " << ec.value() << ") "
                                   << ec.message().c_str() << std::endl;
-                        stop(true);
                     }
+                    stop(true);
                 }
-            );
-#endif
-            total_send_bytes -= PACKET_SIZE;
+            })
+        );
+    }
+
+    void handle_frames()
+    {
+        echo_frames_.clear();
+        int frame_count = echo_frame::parse(data_, recv_length_, buffer_size_, frames_consumed_,
+            [this](const char * frame, uint32_t frame_size, const echo_frame_header & header)
+            {
+                if (header.type != echo_frame::frame_type_echo || need_echo_ == mode_no_echo)
+                    return;
+                uint32_t offset = (uint32_t)(frame - data_);
+                if (!echo_frames_.empty() &&
+                    (echo_frames_.back().first + echo_frames_.back().second) == offset) {
+                    echo_frames_.back().second += frame_size;
+                }
+                else {
+                    echo_frames_.push_back(std::make_pair(offset, frame_size));
+                }
+            });
+
+        if (frame_count < 0) {
+            // Write error log
+            std::cout << "asio_session::handle_frames() - Error: bad frame, the length is more than "
+                      << buffer_size_ << " bytes or the type is unknown." << std::endl;
+            stop(true);
+            return;
+        }
+
+        // Every frame is a request.
+        if (frame_count > 0)
+            g_query_count.add(frame_count);
+
+        if (!echo_frames_.empty()) {
+            do_write_frames();
+        }
+        else {
+            consume_frames();
+            do_read_frames();
         }
     }
-};
 
-} // namespace asio_test
+    void consume_frames()
+    {
+        if (frames_consumed_ > 0) {
+            uint32_t remain = recv_length_ - frames_consumed_;
+            if (remain > 0)
+                ::memmove(data_, data_ + frames_consumed_, remain);
+            recv_length_ = remain;
+            frames_consumed_ = 0;
+        }
+    }
 
-#undef USE_ATOMIC_REALTIME_UPDATE
-#undef QUERY_COUNTER_INTERVAL
+    void do_write_frames()
+    {
+        echo_buffers_.clear();
+        for (std::size_t i = 0; i < echo_frames_.size(); ++i) {
+            echo_buffers_.push_back(boost::asio::buffer(data_ + echo_frames_[i].first, echo_frames_[i].second));
+        }
 
-#undef MAX_UPDATE_CNT
-#undef MAX_UPDATE_BYTES
+        boost::asio::async_write(socket_, echo_buffers_,
+            make_custom_alloc_handler(buffer_->write_memory,
+            [this](const boost::system::error_code & ec, std::size_t send_bytes)
+            {
+                if (!ec) {
+                    // Count the sent bytes
+                    do_send_counter((uint32_t)send_bytes);
+                    do_heartbeat_counter();
+
+                    consume_frames();
+                    do_read_frames();
+                }
+                else {
+                    // Write error log
+                    std::cout << "asio_session::do_write_frames() - Error: (code = " << ec.value() << ") "
+                              << ec.message().c_str() << std::endl;
+                    stop(true);
+                }
+            })
+        );
+    }
+};
+
+} // namespace asio_test
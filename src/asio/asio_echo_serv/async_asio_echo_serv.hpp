@@ -2,6 +2,7 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 #include <thread>
 #include <functional>
 #include <boost/noncopyable.hpp>
@@ -32,6 +33,7 @@ public:
         : io_service_pool_(pool_size), acceptor_(io_service_pool_.get_first_io_service()),
           packet_size_(packet_size)
     {
+        create_connection_pools();
         start(ip_addr, port);
     }
 
@@ -41,6 +43,7 @@ public:
           acceptor_(io_service_pool_.get_first_io_service(), ip::tcp::endpoint(ip::tcp::v4(), port)),
           packet_size_(packet_size)
     {
+        create_connection_pools();
         do_accept();
     }
 
@@ -81,6 +84,14 @@ public:
     }
 
 private:
+    void create_connection_pools()
+    {
+        // One connection pool per io_service, the connections can only be recycled in their own io_service.
+        for (std::size_t i = 0; i < io_service_pool_.size(); ++i) {
+            connection_pools_.push_back(std::make_shared< session_pool<asio_connection> >(g_session_pool_size));
+        }
+    }
+
     void handle_accept(const boost::system::error_code & ec, asio_connection * conn)
     {
         if (!ec) {
@@ -93,8 +104,7 @@ private:
             std::cout << "async_asio_echo_serv::handle_accept() - Error: (code = " << ec.value() << ") "
                       << ec.message().c_str() << std::endl;
             if (conn) {
-                conn->stop();
-                delete conn;
+                conn->stop(true);
             }
         }
 
@@ -103,7 +113,9 @@ private:
 
     void do_accept()
     {
-        asio_connection * new_conn = new asio_connection(io_service_pool_.get_io_service(), packet_size_);
+        std::size_t service_index = io_service_pool_.get_next_index();
+        asio_connection * new_conn = connection_pools_[service_index]->acquire(
+            io_service_pool_.get_io_service(service_index), packet_size_, connection_pools_[service_index].get());
         acceptor_.async_accept(new_conn->socket(), boost::bind(&async_asio_echo_serv::handle_accept,
             this, boost::asio::placeholders::error, new_conn));
     }
@@ -130,7 +142,10 @@ private:
     }
 
 private:
+    typedef std::shared_ptr< session_pool<asio_connection> >  connection_pool_ptr;
+
     io_service_pool					    io_service_pool_;
+    std::vector<connection_pool_ptr>    connection_pools_;
     boost::asio::ip::tcp::acceptor	    acceptor_;
     std::shared_ptr<asio_connection>    conn_;
     std::shared_ptr<std::thread>	    thread_;
@@ -2,18 +2,40 @@
 
 #include <stdint.h>
 #include <atomic>
+#include <string>
+#include <vector>
 #include "common/padding_atomic.hpp"
+#include "common/sharded_counter.hpp"
+#include "common/sharded_histogram.hpp"
 
 extern uint32_t g_test_mode;
 extern uint32_t g_test_method;
 extern uint32_t g_nodelay;
+extern uint32_t g_reuse_port;
+extern uint32_t g_numa_local;
+extern uint32_t g_session_pool_size;
+extern uint32_t g_pending_accepts;
 extern uint32_t g_need_echo;
 extern uint32_t g_packet_size;
+extern uint32_t g_protocol;
+extern uint32_t g_sink_trunc;
+extern uint32_t g_engine;
+extern uint32_t g_busy_poll;
+extern uint32_t g_so_busy_poll;
+extern uint32_t g_console_stats;
 
 extern std::string g_test_mode_str;
 extern std::string g_test_method_str;
 extern std::string g_test_mode_full_str;
 extern std::string g_nodelay_str;
+extern std::string g_reuse_port_str;
+extern std::string g_cpu_list_str;
+extern std::string g_protocol_str;
+extern std::string g_engine_str;
+extern std::string g_stats_port;
+
+extern std::vector<int> g_cpu_list;
+extern std::vector<std::string> g_http_routes;
 extern std::string g_rpc_topic;
 
 extern std::string g_server_ip;
@@ -26,6 +48,11 @@ enum session_mode_t {
     mode_need_echo = 1
 };
 
+enum io_engine_t {
+    engine_asio,
+    engine_io_uring
+};
+
 enum test_mode_t {
     test_mode_unknown,
     test_mode_echo_server,
@@ -46,12 +73,24 @@ enum test_method_t {
     test_method_default = -1
 };
 
-extern padding_atomic<uint64_t> g_query_count;
+/// The echo sessions of the no-echo server (or --echo=0) only drain the data.
+inline uint32_t get_echo_session_mode()
+{
+    return (((g_test_mode == test_mode_no_echo_server) || (g_need_echo == 0)) ? mode_no_echo : mode_need_echo);
+}
+
+extern sharded_counter g_query_count;
 extern padding_atomic<uint32_t> g_client_count;
 
-extern padding_atomic<uint64_t> g_recv_bytes;
-extern padding_atomic<uint64_t> g_send_bytes;
+extern sharded_counter g_recv_bytes;
+extern sharded_counter g_send_bytes;
+
+extern padding_atomic<uint64_t> g_handler_heap_allocs;
+
+// The accepted connections, and the time from an idle session becoming readable to its
+// response being written (in nanoseconds), every wake-up of an idle session is a heartbeat.
+extern padding_atomic<uint64_t> g_accept_count;
+extern sharded_histogram g_heartbeat_latency;
 
-extern const std::string g_response_html;
 
 }
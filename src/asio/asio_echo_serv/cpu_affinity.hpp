@@ -0,0 +1,188 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <fstream>
+#include <algorithm>
+
+#if defined(_WIN32) || defined(WIN32) || defined(OS_WINDOWS) || defined(_WINDOWS)
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+#include "common/cmd_utils.hpp"
+
+namespace asio_test {
+
+// The cpus which a thread can be bound to are less than it (see bind_thread_to_cpu()).
+#if defined(_WIN32) || defined(WIN32) || defined(OS_WINDOWS) || defined(_WINDOWS)
+static const unsigned int kMaxCpuCount = sizeof(DWORD_PTR) * 8;
+#elif defined(__linux__)
+static const unsigned int kMaxCpuCount = CPU_SETSIZE;
+#else
+static const unsigned int kMaxCpuCount = 1024;
+#endif
+
+//
+// Parse a cpu list, the format is the same as taskset(1) and /sys/devices/system/cpu/online,
+// for example: "0-3,8,10-11". A cpu of kMaxCpuCount or more is an error.
+//
+static
+bool parse_cpu_list(const std::string & cpu_list, std::vector<int> & cpus)
+{
+    cpus.clear();
+    std::string::const_iterator iter = cpu_list.begin();
+    while (iter != cpu_list.end()) {
+        unsigned int first, last;
+        if (parse_number_u32(iter, cpu_list.end(), first) <= 0)
+            return false;
+        last = first;
+        if (iter != cpu_list.end() && *iter == '-') {
+            ++iter;
+            if (parse_number_u32(iter, cpu_list.end(), last) <= 0 || last < first)
+                return false;
+        }
+        if (last >= kMaxCpuCount)
+            return false;
+        for (unsigned int cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back((int)cpu);
+        }
+        if (iter != cpu_list.end()) {
+            // Skip the separator and any trailing '\n' of the sysfs files.
+            if (*iter != ',' && *iter != '\n')
+                return false;
+            ++iter;
+        }
+    }
+    return !cpus.empty();
+}
+
+static
+bool read_sysfs_cpu_list(const std::string & filename, std::vector<int> & cpus)
+{
+    std::ifstream ifs(filename.c_str());
+    if (!ifs.is_open())
+        return false;
+    std::string cpu_list;
+    std::getline(ifs, cpu_list);
+    return parse_cpu_list(cpu_list, cpus);
+}
+
+/// Get all of the online logical cpus.
+static
+void get_logical_cpus(std::vector<int> & cpus)
+{
+#if defined(__linux__)
+    if (read_sysfs_cpu_list("/sys/devices/system/cpu/online", cpus))
+        return;
+#endif
+    cpus.clear();
+    int cpu_count = (int)std::thread::hardware_concurrency();
+    for (int cpu = 0; cpu < cpu_count; ++cpu) {
+        cpus.push_back(cpu);
+    }
+}
+
+/// Return the first cpu of the list which is not online, or -1 if all of them are.
+static
+int find_offline_cpu(const std::vector<int> & cpus)
+{
+    std::vector<int> online_cpus;
+    get_logical_cpus(online_cpus);
+    for (std::size_t i = 0; i < cpus.size(); ++i) {
+        if (std::find(online_cpus.begin(), online_cpus.end(), cpus[i]) == online_cpus.end())
+            return cpus[i];
+    }
+    return -1;
+}
+
+/// Get the first logical cpu of every physical core (skip the hyper-threading siblings).
+static
+void get_physical_cores(std::vector<int> & cpus)
+{
+    std::vector<int> logical_cpus;
+    get_logical_cpus(logical_cpus);
+
+    cpus.clear();
+    for (std::size_t i = 0; i < logical_cpus.size(); ++i) {
+        int cpu = logical_cpus[i];
+#if defined(__linux__)
+        std::vector<int> siblings;
+        if (read_sysfs_cpu_list("/sys/devices/system/cpu/cpu" + std::to_string(cpu)
+                                + "/topology/thread_siblings_list", siblings)) {
+            if (*std::min_element(siblings.begin(), siblings.end()) != cpu)
+                continue;
+        }
+#endif
+        cpus.push_back(cpu);
+    }
+}
+
+/// Get the NUMA node of a cpu, return -1 if it's unknown.
+static
+int get_cpu_numa_node(int cpu)
+{
+#if defined(__linux__)
+    for (int node = 0; node < 1024; ++node) {
+        std::vector<int> node_cpus;
+        if (!read_sysfs_cpu_list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist", node_cpus)) {
+            // The node directories may not be continuous, but node0 always exists in a NUMA kernel.
+            if (node == 0)
+                break;
+            continue;
+        }
+        if (std::find(node_cpus.begin(), node_cpus.end(), cpu) != node_cpus.end())
+            return node;
+    }
+#endif
+    return -1;
+}
+
+/// Bind the current thread to a cpu.
+static
+bool bind_thread_to_cpu(int cpu)
+{
+#if defined(_WIN32) || defined(WIN32) || defined(OS_WINDOWS) || defined(_WINDOWS)
+    if (cpu < 0 || cpu >= (int)(sizeof(DWORD_PTR) * 8))
+        return false;
+    return (::SetThreadAffinityMask(::GetCurrentThread(), ((DWORD_PTR)1) << cpu) != 0);
+#elif defined(__linux__)
+    if (cpu < 0 || cpu >= CPU_SETSIZE)
+        return false;
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+    return (::pthread_setaffinity_np(::pthread_self(), sizeof(cpu_set), &cpu_set) == 0);
+#else
+    return false;
+#endif
+}
+
+//
+// Prefer to allocate the memory of the current thread on a NUMA node, the pages
+// which first touched by this thread will be placed on that node.
+//
+// See: http://man7.org/linux/man-pages/man2/set_mempolicy.2.html
+//
+static
+bool bind_thread_memory_to_node(int node)
+{
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+    static const int kMPOL_PREFERRED = 1;
+    if (node < 0 || node >= 1024)
+        return false;
+    unsigned long node_mask[1024 / (sizeof(unsigned long) * 8)] = { 0 };
+    node_mask[node / (sizeof(unsigned long) * 8)] |= 1UL << (node % (sizeof(unsigned long) * 8));
+    return (::syscall(SYS_set_mempolicy, kMPOL_PREFERRED, node_mask, (unsigned long)(1024 + 1)) == 0);
+#else
+    return false;
+#endif
+}
+
+} // namespace asio_test
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <utility>
+#include <type_traits>
+#include <boost/version.hpp>
+#include <boost/noncopyable.hpp>
+
+#include "common.h"
+
+namespace asio_test {
+
+//
+// Class to manage the memory to be used for handler-based custom allocation.
+// It contains a single block of memory which may be returned for allocation
+// requests. If the memory is in use when an allocation request is made, the
+// allocator delegates allocation to the global heap and counts it.
+//
+// In the sessions, the blocks of the read and write operations are a part of the pooled
+// receive buffer, which is held while the session has data in flight, so a steady-state
+// ping-pong loop needn't any heap allocation. The idle session only keeps a small block for the wait
+// of the readability (see session_buffer and asio_session::do_wait_read()).
+//
+// See: http://www.boost.org/doc/libs/1_66_0/doc/html/boost_asio/example/cpp11/allocation/server.cpp
+//
+template <std::size_t StorageSize>
+class basic_handler_memory : private boost::noncopyable {
+private:
+    enum { kStorageSize = StorageSize };
+
+    // Storage space used for handler-based custom memory allocation.
+    typename std::aligned_storage<kStorageSize>::type storage_;
+
+    // Whether the handler-based custom allocation storage has been used.
+    bool in_use_;
+
+public:
+    basic_handler_memory() : in_use_(false) {}
+    ~basic_handler_memory() {}
+
+    void * allocate(std::size_t size)
+    {
+        if (!in_use_ && size <= sizeof(storage_)) {
+            in_use_ = true;
+            return &storage_;
+        }
+        else {
+            g_handler_heap_allocs.fetch_add(1, std::memory_order_relaxed);
+            return ::operator new(size);
+        }
+    }
+
+    void deallocate(void * pointer)
+    {
+        if (pointer == &storage_) {
+            in_use_ = false;
+        }
+        else {
+            ::operator delete(pointer);
+        }
+    }
+};
+
+// The largest handlers of the reads and writes are the gather write of the framed protocol
+// and the http write (472 and 480 bytes on x64), a handler of exactly 512 bytes still fits.
+typedef basic_handler_memory<512> handler_memory;
+
+// The wait of the readability and the dispatch of the first read (120 bytes on x64).
+typedef basic_handler_memory<128> wait_handler_memory;
+
+// The allocator to be associated with the handler objects. This allocator only
+// needs to satisfy the C++11 minimal allocator requirements.
+template <typename T, typename Memory = handler_memory>
+class handler_allocator {
+private:
+    template <typename, typename> friend class handler_allocator;
+
+    Memory & memory_;
+
+public:
+    typedef T value_type;
+
+    explicit handler_allocator(Memory & mem)
+        : memory_(mem) {}
+
+    template <typename U>
+    handler_allocator(const handler_allocator<U, Memory> & other)
+        : memory_(other.memory_) {}
+
+    template <typename U>
+    struct rebind {
+        typedef handler_allocator<U, Memory> other;
+    };
+
+    bool operator == (const handler_allocator & other) const
+    {
+        return &memory_ == &other.memory_;
+    }
+
+    bool operator != (const handler_allocator & other) const
+    {
+        return &memory_ != &other.memory_;
+    }
+
+    T * allocate(std::size_t n) const
+    {
+        return static_cast<T *>(memory_.allocate(sizeof(T) * n));
+    }
+
+    void deallocate(T * p, std::size_t /*n*/) const
+    {
+        return memory_.deallocate(p);
+    }
+};
+
+// Wrapper class template for handler objects to allow handler memory
+// allocation to be customised. The allocator_type typedef and get_allocator()
+// member function are used by the asynchronous operations to obtain the
+// allocator (Boost 1.66 or newer), the older versions use the asio_handler_allocate()
+// and asio_handler_deallocate() hooks.
+template <typename Handler, typename Memory = handler_memory>
+class custom_alloc_handler {
+private:
+    Memory & memory_;
+    Handler handler_;
+
+public:
+    typedef handler_allocator<Handler, Memory> allocator_type;
+
+    custom_alloc_handler(Memory & mem, Handler h)
+        : memory_(mem), handler_(std::move(h)) {}
+
+    allocator_type get_allocator() const
+    {
+        return allocator_type(memory_);
+    }
+
+    template <typename ...Args>
+    void operator () (Args && ...args)
+    {
+        handler_(std::forward<Args>(args)...);
+    }
+
+#if (BOOST_VERSION < 106600)
+    friend void * asio_handler_allocate(std::size_t size, custom_alloc_handler<Handler, Memory> * this_handler)
+    {
+        return this_handler->memory_.allocate(size);
+    }
+
+    friend void asio_handler_deallocate(void * pointer, std::size_t /*size*/,
+                                        custom_alloc_handler<Handler, Memory> * this_handler)
+    {
+        this_handler->memory_.deallocate(pointer);
+    }
+#endif
+};
+
+// Helper function to wrap a handler object to add custom allocation.
+template <typename Memory, typename Handler>
+inline custom_alloc_handler<Handler, Memory> make_custom_alloc_handler(Memory & mem, Handler handler)
+{
+    return custom_alloc_handler<Handler, Memory>(mem, handler);
+}
+
+} // namespace asio_test
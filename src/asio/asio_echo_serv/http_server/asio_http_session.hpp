@@ -5,38 +5,29 @@
 #include <memory>
 #include <utility>
 #include <atomic>
+#include <vector>
+#include <chrono>
 #include <boost/asio.hpp>
 #include <boost/system/error_code.hpp>
 #include <boost/smart_ptr.hpp>
 
 #include "../common.h"
+#include "../session_pool.hpp"
+#include "../handler_allocator.hpp"
+#include "../socket_options.hpp"
+#include "../mirrored_memory.hpp"
+#include "http_scanner.hpp"
+#include "http_response.hpp"
 
 using namespace boost::system;
 
 #define MIN_PACKET_SIZE             64
 #define MAX_PACKET_SIZE	            (64 * 1024)
 
-// Whether use atomic update realtime?
-#define USE_ATOMIC_REALTIME_UPDATE  0
-
-#define QUERY_COUNTER_INTERVAL      99
-
-#define MAX_UPDATE_CNT              5
-#define MAX_UPDATE_BYTES            32768
-
 using namespace boost::asio;
 
 namespace asio_test {
 
-const std::string g_response_html =
-    "HTTP/1.1 200 OK\r\n"
-    "Date: Fri, 31 Aug 2016 16:25:26 GMT\r\n"
-    "Server: boost-asio\r\n"
-    "Content-Type: text/html\r\n"
-    "Content-Length: 12\r\n"
-    "Connection: Keep-Alive\r\n\r\n"
-    "Hello World!";
-
 ////////////////////////////////////////////////////////////////////////////////////
 /*
 
@@ -45,68 +36,93 @@ const std::string g_response_html =
  Bottom        Back         Parsed              Front                          Top
     |-----------|--------------|------------------|-----------------------------|
                 ^              ^                  ^
+
+ The buffer is a mirrored memory (see mirrored_memory.hpp) of buffer_size bytes, the
+ region [Back, Back + buffer_size) is always contiguous, so the data and the free space
+ wrap around the end without any copy, and Back goes back to the bottom as soon as it
+ passes the first half.
+
+ If the mirrored memory is not available, it falls back to a linear buffer of
+ buffer_size * 2 bytes, and rollback() moves the data back to the bottom.
 */
 ////////////////////////////////////////////////////////////////////////////////////
 
 class http_ring_buffer {
 private:
-    std::unique_ptr<char> buffer_;
+    mirrored_memory mirror_;
+    std::unique_ptr<char[]> linear_;
+    char * bottom_;
     std::size_t buffer_size_;
-    char * top_;
-    char * back_;
-    char * parsed_;
-    char * front_;
+    std::size_t capacity_;
+
+    // The offsets from the bottom.
+    std::size_t back_;
+    std::size_t parsed_;
+    std::size_t front_;
+
+    // The handler memory of the reads and writes, they only run while the buffer is held.
+    handler_memory read_memory_;
+    handler_memory write_memory_;
 
 public:
     http_ring_buffer(std::size_t buffer_size)
-        : buffer_size_(buffer_size), top_(nullptr), back_(nullptr),
-          parsed_(nullptr), front_(nullptr) {
+        : bottom_(nullptr), buffer_size_(buffer_size), capacity_(0),
+          back_(0), parsed_(0), front_(0) {
         init_ring_buffer(buffer_size);
     }
     ~http_ring_buffer() {}
 
 private:
     void init_ring_buffer(std::size_t buffer_size) {
-        char * newBuffer = new (std::nothrow) char [buffer_size * 2];
-        if (newBuffer)
-            ::memset(newBuffer, 0, buffer_size * 2 * sizeof(char));
-        buffer_.reset(newBuffer);
-
-        char * _bottom = buffer_.get();
-        top_ = _bottom + buffer_size * 2;
-        back_ = _bottom;
-        parsed_ = _bottom;
-        front_ = _bottom;
+        if (mirror_.allocate(buffer_size)) {
+            bottom_ = mirror_.data();
+            capacity_ = mirror_.size();
+        }
+        else {
+            linear_.reset(new (std::nothrow) char [buffer_size * 2]);
+            bottom_ = linear_.get();
+            capacity_ = (bottom_ != nullptr) ? (buffer_size * 2) : 0;
+        }
+        reset(0, 0);
     }
 
 public:
+    bool is_mirrored() const { return mirror_.is_mirrored(); }
+
     std::size_t buffer_size() const { return buffer_size_; }
-    std::size_t total_sizes() const { return buffer_size_ * 2; }
-    std::size_t offset() const { return static_cast<std::size_t>(back_ - buffer_.get()); }
-    std::size_t empty_size() const { return offset(); }
-    std::size_t free_size() const { return static_cast<std::size_t>(top_ - front_); }
-    std::size_t data_length() const { return static_cast<std::size_t>(front_ - back_); }
+    std::size_t total_sizes() const { return capacity_; }
+    std::size_t offset() const { return back_; }
+    std::size_t empty_size() const { return (is_mirrored() ? 0 : back_); }
+    std::size_t data_length() const { return (front_ - back_); }
+    std::size_t free_size() const {
+        return (is_mirrored() ? (capacity_ - data_length()) : (capacity_ - front_));
+    }
+
+    std::size_t parse_pos() const { return (parsed_ - back_); }
 
-    std::size_t parse_pos() const { return static_cast<std::size_t>(parsed_ - back_); }
+    char * data() const { return bottom_; }
 
-    char * data() const { return buffer_.get(); }
+    handler_memory & read_memory() { return read_memory_; }
+    handler_memory & write_memory() { return write_memory_; }
 
-    char * bottom() const { return buffer_.get(); }
-    char * top() const { return top_; }
-    char * back() const { return back_; }
-    char * parsed() const { return parsed_; }
-    char * front() const { return front_; }
+    char * bottom() const { return bottom_; }
+    char * top() const { return (bottom_ + capacity_); }
+    char * back() const { return (bottom_ + back_); }
+    char * parsed() const { return (bottom_ + parsed_); }
+    char * front() const { return (bottom_ + front_); }
 
-    void reset(std::size_t data_bytes, std::size_t parsed_pos) {
-        char * _bottom = buffer_.get();
-        back_ = _bottom;
-        parsed_ = _bottom + parsed_pos;
-        front_ = _bottom + data_bytes;
+    void reset(std::size_t data_bytes = 0, std::size_t parsed_pos = 0) {
+        back_ = 0;
+        parsed_ = parsed_pos;
+        front_ = data_bytes;
     }
 
     void rollback() {
+        // The mirrored buffer never need to move the data.
+        if (is_mirrored())
+            return;
+
         std::size_t empty_bytes = empty_size();
-        std::size_t free_bytes = free_size();
         std::size_t data_bytes = data_length();
         std::size_t parsed_offset = parse_pos();
 
@@ -121,81 +137,66 @@ public:
     }
 
     bool read(std::size_t recv_size) {
-        if (front_ + recv_size < top_) {
+        if (recv_size <= free_size()) {
             front_ += recv_size;
             return true;
         }
         else {
-            front_ = top_;
+            front_ += free_size();
             return false;
         }
     }
 
     void parse_to(char * parsed) {
-        back_ = parsed;
-        parsed_ = parsed;
+        consume(static_cast<std::size_t>(parsed - back()));
     }
 
     bool parse_add(std::size_t parse_size) {
-        if (parsed_ + parse_size < top_) {
-            parsed_ += parse_size;
-            back_ = parsed_;
+        if (parse_size <= data_length()) {
+            consume(parse_size);
             return true;
         }
         else {
-            parsed_ = top_;
-            back_ = top_;
+            consume(data_length());
             return false;
         }
     }
 
-    bool parse(char * &parsed) {
-#if 1
-        // Back-tracking find method
-        char * cur = front_ - 4;
-        while (cur >= parsed_) {
-            if (cur[0] == '\r') {
-                if (cur[2] == '\r') {
-                    if (cur[1] == '\n' && cur[3] == '\n') {
-                        parsed = (cur + 4);
-                        return true;
-                    }
-                    // TODO: If HTTP header request format is standard, this way is Ok.
-                    cur -= 4;
-                }
-                else if (cur[1] == '\n') {
-                    cur -= 2;
-                }
-                else {
-                    cur -= 4;
-                }
-            }
-            else if (cur[0] == '\n') {
-                cur--;
-            }
-            else {
-                cur -= 4;
-            }
-        }
-        parsed = front_;
-        return false;
-#else
-        // Forward-tracking find method
-        char * cur = parsed_;
-        while (cur <= (front_ - 4)) {
-            if (cur[0] == '\r' && cur[2] == '\n'
-                && cur[1] == '\r' && cur[3] == '\n') {
-                parsed = (cur + 4);
-                return true;
-            }
-            cur++;
+    //
+    // Find the end of every complete http request header ("\r\n\r\n") in one pass,
+    // the boundaries are the end offsets of the requests relative to the old back().
+    // The scan resumes from the parsed position, the bytes before it needn't be scanned
+    // again when more data is recieved. Return the count of the complete requests.
+    //
+    std::size_t parse(std::vector<uint32_t> & boundaries) {
+        boundaries.clear();
+        http_scanner::scan(back(), parse_pos(), data_length(), boundaries);
+        parsed_ = front_;
+        if (!boundaries.empty())
+            consume(boundaries.back());
+        return boundaries.size();
+    }
+
+private:
+    void consume(std::size_t bytes) {
+        back_ += bytes;
+        if (parsed_ < back_)
+            parsed_ = back_;
+        if (is_mirrored() && back_ >= capacity_) {
+            // Wrap around, the same bytes are visible in the first half.
+            back_ -= capacity_;
+            parsed_ -= capacity_;
+            front_ -= capacity_;
         }
-        parsed = (cur - 1);
-        return false;
-#endif
     }
 };
 
+//
+// The ring buffers are pooled per io_service, a session only holds one while it has
+// unparsed bytes or a pending read, the idle sessions wait for the readability without it.
+//
+typedef session_pool<http_ring_buffer> http_buffer_pool;
+
 class asio_http_session : public boost::enable_shared_from_this<asio_http_session>,
                           private boost::noncopyable {
 private:
@@ -206,26 +207,50 @@ private:
     uint32_t    need_echo_;
     uint32_t    buffer_size_;
     uint32_t    packet_size_;
-    uint64_t    query_count_;
-
-    uint32_t    recv_bytes_;
-    uint32_t    send_bytes_;
-    uint32_t    recv_cnt_;
-    uint32_t    send_cnt_;
-
-    uint32_t    delta_query_count_;
     uint32_t    recv_bytes_remain_;
     uint32_t    send_bytes_remain_;
 
-    http_ring_buffer buffer_;
+    // The ring buffer is null while the session is idle. If the last read drained the
+    // socket, the next read waits for the readability first (see do_wait_read()).
+    http_buffer_pool * buffer_pool_;
+    http_ring_buffer * buffer_;
+    bool        recv_drained_;
+
+    // When the idle session woke up, the heartbeat is done when its responses are written.
+    bool        heartbeat_;
+    std::chrono::steady_clock::time_point wake_time_;
+
+    // The begin of the pipelined requests found by the last parse, and their end offsets.
+    const char *          requests_;
+    std::vector<uint32_t> request_boundaries_;
+
+    // The routes, and a copy of the Date line for the pending responses.
+    const http_response_table * responses_;
+    char        date_line_[http_date_cache::kDateLineSize];
+
+    // The gather buffers of the pipelined responses.
+    std::vector<boost::asio::const_buffer> response_buffers_;
+    std::size_t response_bytes_;
+
+    session_pool<asio_http_session> * pool_;
+
+    // The handler memory of the wait and the first read dispatch, they run without a buffer,
+    // the reads and writes use the handler memory of the ring buffer.
+    wait_handler_memory wait_memory_;
 
 public:
     asio_http_session(boost::asio::io_service & io_service, uint32_t buffer_size,
-                      uint32_t packet_size, uint32_t need_echo = mode_need_echo)
+                      uint32_t packet_size, uint32_t need_echo = mode_need_echo,
+                      session_pool<asio_http_session> * pool = nullptr,
+                      const http_response_table * responses = nullptr,
+                      http_buffer_pool * buffer_pool = nullptr)
         : socket_(io_service), nodelay_(false), need_echo_(need_echo), buffer_size_(buffer_size), packet_size_(packet_size),
-          query_count_(0), recv_bytes_(0), send_bytes_(0), recv_cnt_(0), send_cnt_(0), delta_query_count_(0),
-          recv_bytes_remain_(0), send_bytes_remain_(0), buffer_(buffer_size)
+          recv_bytes_remain_(0), send_bytes_remain_(0), buffer_pool_(buffer_pool), buffer_(nullptr),
+          recv_drained_(false), heartbeat_(false), requests_(nullptr),
+          responses_(responses), response_bytes_(0), pool_(pool)
     {
+        if (responses_ == nullptr)
+            responses_ = &http_response_table::default_table();
         nodelay_ = (g_nodelay != 0);
         if (buffer_size_ > MAX_PACKET_SIZE)
             buffer_size_ = MAX_PACKET_SIZE;
@@ -235,12 +260,14 @@ public:
 
     ~asio_http_session()
     {
+        boost::system::error_code ec;
 #if !defined(_WIN32_WINNT) || (_WIN32_WINNT >= 0x0600)
-        socket_.cancel();
+        socket_.cancel(ec);
 #endif
         //socket_.shutdown(socket_base::shutdown_both);
         if (socket_.is_open())
-            socket_.close();
+            socket_.close(ec);
+        delete buffer_;
     }
 
     void start()
@@ -261,14 +288,62 @@ public:
         sLinger.l_linger = 5;   // After shutdown(), socket send/recv 5 second data yet.
         ::setsockopt(socket_.native_handle(), SOL_SOCKET, SO_LINGER, (const char *)&sLinger, sizeof(sLinger));
 
-        do_read_some();
+#if HAS_SOCKET_BUSY_POLL
+        if (g_so_busy_poll != 0) {
+            // Raising it above net.core.busy_read needs CAP_NET_ADMIN, the error is ignored.
+            boost::system::error_code ec;
+            socket_.set_option(busy_poll((int)g_so_busy_poll), ec);
+        }
+#endif
+
+        // The new session waits for its first request without a buffer too. The socket can only
+        // be checked before a wait in the thread of the io_service (see do_wait_read()), so the
+        // first read is dispatched to it, it runs at once if the session is accepted in its own thread.
+#if (BOOST_VERSION >= 106600)
+        boost::asio::dispatch(socket_.get_executor(),
+#else
+        socket_.get_io_service().dispatch(
+#endif
+            make_custom_alloc_handler(wait_memory_,
+            [this]()
+            {
+                // do_wait_read() checks the socket, and reads at once if the request is already here.
+                recv_drained_ = true;
+                do_read_some();
+            })
+        );
     }
 
     void stop(bool delete_self = false)
     {
         g_client_count--;
-        if (delete_self)
-            delete this;
+        if (delete_self) {
+            if (pool_)
+                pool_->release(this);
+            else
+                delete this;
+        }
+    }
+
+    /// Clear the state before the session be recycled by the session pool.
+    void reset()
+    {
+        boost::system::error_code ec;
+        if (socket_.is_open())
+            socket_.close(ec);
+
+        recv_bytes_remain_ = 0;
+        send_bytes_remain_ = 0;
+
+        recv_drained_ = false;
+        heartbeat_ = false;
+        release_buffer();
+        if (buffer_ != nullptr)
+            buffer_->reset();
+        requests_ = nullptr;
+        request_boundaries_.clear();
+        response_buffers_.clear();
+        response_bytes_ = 0;
     }
 
     ip::tcp::socket & socket()
@@ -308,118 +383,82 @@ private:
         socket_.set_option(recv_bufsize_option);
     }
 
-    inline void do_recieve_counter(uint32_t bytes_recieved)
+    void acquire_buffer()
     {
-#if defined(USE_ATOMIC_REALTIME_UPDATE) && (USE_ATOMIC_REALTIME_UPDATE > 0)
-        if (bytes_recieved > 0) {
-            g_recv_bytes.fetch_add(bytes_recieved);
+        if (buffer_ == nullptr) {
+            if (buffer_pool_ != nullptr)
+                buffer_ = buffer_pool_->acquire(buffer_size_);
+            else
+                buffer_ = new http_ring_buffer(buffer_size_);
         }
-#else
+    }
+
+    void release_buffer()
+    {
+        // Without a buffer pool, the session keeps its buffer until it is deleted.
+        if (buffer_ != nullptr && buffer_pool_ != nullptr) {
+            buffer_pool_->release(buffer_);
+            buffer_ = nullptr;
+        }
+    }
+
+    inline void do_heartbeat_counter()
+    {
+        if (heartbeat_) {
+            heartbeat_ = false;
+            g_heartbeat_latency.record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                       std::chrono::steady_clock::now() - wake_time_).count());
+        }
+    }
+
+    inline void do_recieve_counter(uint32_t bytes_recieved)
+    {
         if (bytes_recieved > 0) {
-            recv_bytes_ += bytes_recieved;
-            recv_cnt_++;
-            if (recv_cnt_ >= MAX_UPDATE_CNT || recv_bytes_ >= MAX_UPDATE_BYTES) {
-                g_recv_bytes.fetch_add(recv_bytes_);
-                recv_bytes_ = 0;
-                recv_cnt_ = 0;
-            }
+            g_recv_bytes.add(bytes_recieved);
         }
-#endif
     }
 
     inline void do_send_counter(uint32_t byte_sent)
     {
-#if defined(USE_ATOMIC_REALTIME_UPDATE) && (USE_ATOMIC_REALTIME_UPDATE > 0)
         if (byte_sent > 0) {
-            g_send_bytes.fetch_add(byte_sent);
-        }
-#else
-        if (byte_sent > 0) {
-            send_bytes_ += byte_sent;
-            send_cnt_++;
-            if (send_cnt_ >= MAX_UPDATE_CNT || send_bytes_ >= MAX_UPDATE_BYTES) {
-                g_send_bytes.fetch_add(send_bytes_);
-                send_bytes_ = 0;
-                send_cnt_ = 0;
-            }
+            g_send_bytes.add(byte_sent);
         }
-#endif
     }
 
     inline void do_query_counter()
     {
-#if defined(USE_ATOMIC_REALTIME_UPDATE) && (USE_ATOMIC_REALTIME_UPDATE > 0)
-        g_query_count.fetch_add(1);
-#else
-        query_count_++;
-        if (query_count_ >= QUERY_COUNTER_INTERVAL) {
-            g_query_count.fetch_add(QUERY_COUNTER_INTERVAL);
-            query_count_ = 0;
-        }
-#endif
+        g_query_count.add(1);
     }
 
     inline void do_query_counter_read_some(uint32_t recv_bytes)
     {
         uint32_t delta_bytes = recv_bytes_remain_ + recv_bytes;
-        if (delta_bytes >= packet_size_) {
-            uint32_t delta_query_count = delta_bytes / packet_size_;
-#if defined(USE_ATOMIC_REALTIME_UPDATE) && (USE_ATOMIC_REALTIME_UPDATE > 0)
-            if (delta_query_count > 0) {
-                g_query_count.fetch_add(delta_query_count);
-                recv_bytes_remain_ = delta_bytes - packet_size_ * delta_query_count;
-                return;
-            }
-#else
-            if (delta_query_count >= QUERY_COUNTER_INTERVAL) {
-                g_query_count.fetch_add(delta_query_count);
-                recv_bytes_remain_ = delta_bytes - packet_size_ * delta_query_count;
-                return;
-            }
-#endif
+        uint32_t delta_query_count = delta_bytes / packet_size_;
+        if (delta_query_count > 0) {
+            g_query_count.add(delta_query_count);
         }
-        recv_bytes_remain_ = delta_bytes;
+        recv_bytes_remain_ = delta_bytes - packet_size_ * delta_query_count;
     }
 
     inline void do_query_counter_write_some(uint32_t send_bytes)
     {
         uint32_t delta_bytes = send_bytes_remain_ + send_bytes;
-        static const uint32_t reponse_size = (uint32_t)g_response_html.size();
-        if (delta_bytes >= reponse_size) {
-            uint32_t delta_query_count = delta_bytes / reponse_size;
-#if defined(USE_ATOMIC_REALTIME_UPDATE) && (USE_ATOMIC_REALTIME_UPDATE > 0)
-            if (delta_query_count > 0) {
-                g_query_count.fetch_add(delta_query_count);
-                send_bytes_remain_ = delta_bytes - reponse_size * delta_query_count;
-                return;
-            }
-#else
-            if (delta_query_count >= QUERY_COUNTER_INTERVAL) {
-                g_query_count.fetch_add(delta_query_count);
-                send_bytes_remain_ = delta_bytes - reponse_size * delta_query_count;
-                return;
-            }
-#endif
+        uint32_t delta_query_count = delta_bytes / packet_size_;
+        if (delta_query_count > 0) {
+            g_query_count.add(delta_query_count);
         }
-        send_bytes_remain_ = delta_bytes;
+        send_bytes_remain_ = delta_bytes - packet_size_ * delta_query_count;
     }
 
-    inline void do_query_counter_sync_write()
+    inline void do_query_counter_sync_write(uint32_t request_count)
     {
-#if defined(USE_ATOMIC_REALTIME_UPDATE) && (USE_ATOMIC_REALTIME_UPDATE > 0)
-        g_query_count.fetch_add(1);
-#else
-        delta_query_count_++;
-        if (delta_query_count_ >= QUERY_COUNTER_INTERVAL) {
-            g_query_count.fetch_add(delta_query_count_);
-            delta_query_count_ = 0;
-        }
-#endif
+        g_query_count.add(request_count);
     }
 
     void do_read()
     {
-        boost::asio::async_read(socket_, boost::asio::buffer(buffer_.data(), packet_size_),
+        boost::asio::async_read(socket_, boost::asio::buffer(buffer_->data(), packet_size_),
+            make_custom_alloc_handler(buffer_->read_memory(),
             [this](const boost::system::error_code & ec, std::size_t recv_bytes)
             {
                 if ((uint32_t)recv_bytes != packet_size_) {
@@ -434,18 +473,22 @@ private:
                     do_write();
                 }
                 else {
-                    // Write error log
-                    std::cout << "asio_http_session::do_read() - Error: (code = " << ec.value() << ") "
-                              << ec.message().c_str() << std::endl;
+                    // The peer closing the connection is the normal end of a session.
+                    if (ec != boost::asio::error::eof) {
+                        // Write error log
+                        std::cout << "asio_http_session::do_read() - Error: (code = " << ec.value() << ") "
+                                  << ec.message().c_str() << std::endl;
+                    }
                     stop(true);
                 }
-            }
+            })
         );
     }
 
     void do_write()
     {
-        boost::asio::async_write(socket_, boost::asio::buffer(buffer_.data(), packet_size_),
+        boost::asio::async_write(socket_, boost::asio::buffer(buffer_->data(), packet_size_),
+            make_custom_alloc_handler(buffer_->write_memory(),
             [this](const boost::system::error_code & ec, std::size_t send_bytes)
             {
                 if (!ec) {
@@ -468,21 +511,140 @@ private:
                               << ec.message().c_str() << std::endl;
                     stop(true);
                 }
-            }
+            })
         );
     }
 
+    uint32_t parse_http_requests()
+    {
+        // Parse all of the complete requests in the buffer (HTTP pipelining).
+        // The parsed requests stay in the buffer until the next read.
+        requests_ = buffer_->back();
+        return (uint32_t)buffer_->parse(request_boundaries_);
+    }
+
+    bool prepare_read_buffer()
+    {
+        if (buffer_->data_length() == 0) {
+            // All of the requests have been parsed, restart from the bottom.
+            buffer_->reset(0, 0);
+        }
+        else if (buffer_->free_size() < buffer_->buffer_size()) {
+            // Roll back the ring buffer
+            buffer_->rollback();
+        }
+        // If there is still no space, the request header is too large.
+        return (buffer_->free_size() > 0);
+    }
+
+    void prepare_http_responses(uint32_t request_count)
+    {
+        // One response for every pipelined request: the prebuilt head, the Date line and
+        // the body of its route, send them by one gather write.
+        ::memcpy(date_line_, http_date_cache::get(), sizeof(date_line_));
+
+        response_buffers_.clear();
+        response_bytes_ = 0;
+        uint32_t request_begin = 0;
+        for (uint32_t i = 0; i < request_count; ++i) {
+            uint32_t request_end = request_boundaries_[i];
+            const http_route & route = responses_->match(requests_ + request_begin, request_end - request_begin);
+            response_buffers_.push_back(boost::asio::buffer(route.head.c_str(), route.head.size()));
+            response_buffers_.push_back(boost::asio::buffer(date_line_, sizeof(date_line_)));
+            if (!route.body.empty())
+                response_buffers_.push_back(boost::asio::buffer(route.body.c_str(), route.body.size()));
+            response_bytes_ += route.head.size() + sizeof(date_line_) + route.body.size();
+            request_begin = request_end;
+        }
+    }
+
+    //
+    // Wait until the socket is readable without a ring buffer, it is used when the last read
+    // has drained the socket, the buffer is given back to the pool if nothing is buffered.
+    //
+    // The sockets are edge-triggered in the epoll reactor, and a wait operation is never
+    // tried speculatively. A short read doesn't make the wait safe: the reactor may consume
+    // the edge of the data which arrives after the read, before the wait is queued. So the
+    // socket is checked again right before the wait, in the thread of the io_service where
+    // no epoll_wait() can run in between, and the session only parks if it is still drained.
+    //
+    void do_wait_read()
+    {
+        if (!is_socket_drained(socket_)) {
+            // The data (or the eof) is already here, read it at once.
+            recv_drained_ = false;
+            do_read_some();
+            return;
+        }
+
+        if (buffer_ != nullptr && buffer_->data_length() == 0)
+            release_buffer();
+
+#if (BOOST_VERSION >= 106600)
+        socket_.async_wait(ip::tcp::socket::wait_read,
+            make_custom_alloc_handler(wait_memory_,
+            [this](const boost::system::error_code & ec)
+            {
+                handle_wait_read(ec);
+            })
+        );
+#else
+        socket_.async_read_some(boost::asio::null_buffers(),
+            make_custom_alloc_handler(wait_memory_,
+            [this](const boost::system::error_code & ec, std::size_t /* recv_bytes */)
+            {
+                handle_wait_read(ec);
+            })
+        );
+#endif
+    }
+
+    void handle_wait_read(const boost::system::error_code & ec)
+    {
+        if (!ec) {
+            recv_drained_ = false;
+            if (!heartbeat_) {
+                heartbeat_ = true;
+                wake_time_ = std::chrono::steady_clock::now();
+            }
+            do_read_some();
+        }
+        else {
+            // Write error log
+#if 0
+            std::cout << "asio_http_session::do_wait_read() - Error: (code = " << ec.value() << ") "
+                      << ec.message().c_str() << std::endl;
+#endif
+            stop(true);
+        }
+    }
+
     void do_read_some()
     {
         static bool is_first_read = true;
         static int debug_output_cnt = 0;
 
-        char * read_data = buffer_.front();
-        std::size_t read_size = buffer_.free_size();
+        if (recv_drained_) {
+            do_wait_read();
+            return;
+        }
+
+        acquire_buffer();
+        if (!prepare_read_buffer()) {
+            std::cout << "asio_http_session::do_read_some() - Error: the http request is more than "
+                      << buffer_->buffer_size() << " bytes." << std::endl;
+            stop(true);
+            return;
+        }
+
+        char * read_data = buffer_->front();
+        std::size_t read_size = buffer_->free_size();
 
         socket_.async_read_some(boost::asio::buffer(read_data, read_size),
-            [this](const boost::system::error_code & ec, std::size_t recv_bytes)
+            make_custom_alloc_handler(buffer_->read_memory(),
+            [this, read_size](const boost::system::error_code & ec, std::size_t recv_bytes)
             {
+                recv_drained_ = (recv_bytes < read_size);
                 if (!ec) {
                     if (is_first_read) {
                         packet_size_ = (uint32_t)recv_bytes;
@@ -501,32 +663,24 @@ private:
                     // Count the recieved bytes
                     do_recieve_counter((uint32_t)recv_bytes);
 
-                    bool is_overflow = buffer_.read(recv_bytes);
-                    if (!is_overflow) {
-                        // Roll back the ring buffer
-                        buffer_.rollback();
+                    buffer_->read(recv_bytes);
 
-                        do_read_some();
-                        return;
-                    }
-                    
-                    char * scanned;
-                    bool http_header_ok = buffer_.parse(scanned);
-                    if (http_header_ok) {
-                        buffer_.parse_to(scanned);
+                    uint32_t request_count = parse_http_requests();
+                    if (request_count > 0) {
+                        prepare_http_responses(request_count);
 
-                        // A successful http request, can be used to statistic qps.
+                        // Successful http requests, can be used to statistic qps.
                         if (!nodelay_) {
                             // nodelay = false;
 #if 1
-                            do_async_write_http_response();
+                            do_async_write_http_response(request_count);
 #else
-                            do_async_write_http_response_some();
+                            do_async_write_http_response_some(request_count);
 #endif
                         }
                         else {
                             // nodelay = true;
-                            do_sync_write_http_response();
+                            do_sync_write_http_response(request_count);
                         }
                     }
                     else {
@@ -542,21 +696,19 @@ private:
 #endif
                     stop(true);
                 }
-            }
+            })
         );
     }
 
-    void do_sync_write_http_response()
+    void do_sync_write_http_response(uint32_t request_count)
     {
         static bool is_first_read = true;
         boost::system::error_code ec;
-        std::size_t send_bytes = boost::asio::write(socket_,
-            boost::asio::buffer(g_response_html.c_str(), g_response_html.size()),
-            ec);
+        std::size_t send_bytes = boost::asio::write(socket_, response_buffers_, ec);
         if (!ec) {
 #if 0
             if (is_first_read) {
-                std::cout << "g_response_html.size() = " << g_response_html.size() << std::endl;
+                std::cout << "response_bytes_ = " << response_bytes_ << std::endl;
                 is_first_read = false;
             }
 #endif
@@ -564,9 +716,10 @@ private:
             do_send_counter((uint32_t)send_bytes);
 
             // If get a circle of ping-pong, we count the query one time.
-            do_query_counter_sync_write();
+            do_query_counter_sync_write(request_count);
+            do_heartbeat_counter();
 
-            if ((uint32_t)send_bytes != g_response_html.size() && send_bytes != 0) {
+            if (send_bytes != response_bytes_ && send_bytes != 0) {
                 std::cout << "asio_http_session::do_sync_write_http_response(): async_write(), send_bytes = "
                             << send_bytes << " bytes." << std::endl;
             }
@@ -582,16 +735,17 @@ private:
         }
     }
 
-    void do_async_write_http_response()
+    void do_async_write_http_response(uint32_t request_count)
     {
         static bool is_first_read = true;
-        boost::asio::async_write(socket_, boost::asio::buffer(g_response_html.c_str(), g_response_html.size()),
-            [this](const boost::system::error_code & ec, std::size_t send_bytes)
+        boost::asio::async_write(socket_, response_buffers_,
+            make_custom_alloc_handler(buffer_->write_memory(),
+            [this, request_count](const boost::system::error_code & ec, std::size_t send_bytes)
             {
                 if (!ec) {
 #if 0
                     if (is_first_read) {
-                        std::cout << "g_response_html.size() = " << g_response_html.size() << std::endl;
+                        std::cout << "response_bytes_ = " << response_bytes_ << std::endl;
                         is_first_read = false;
                     }
 #endif
@@ -599,9 +753,10 @@ private:
                     do_send_counter((uint32_t)send_bytes);
 
                     // If get a circle of ping-pong, we count the query one time.
-                    do_query_counter_sync_write();
+                    do_query_counter_sync_write(request_count);
+                    do_heartbeat_counter();
 
-                    if ((uint32_t)send_bytes != g_response_html.size() && send_bytes != 0) {
+                    if (send_bytes != response_bytes_ && send_bytes != 0) {
                         std::cout << "asio_http_session::do_async_write_http_response(): async_write(), send_bytes = "
                                   << send_bytes << " bytes." << std::endl;
                     }
@@ -615,20 +770,21 @@ private:
                               << ec.message().c_str() << std::endl;
                     stop(true);
                 }
-            }
+            })
         );
     }
 
-    void do_async_write_http_response_some()
+    void do_async_write_http_response_some(uint32_t request_count)
     {
         static bool is_first_read = true;
-        socket_.async_write_some(boost::asio::buffer(g_response_html.c_str(), g_response_html.size()),
-            [this](const boost::system::error_code & ec, std::size_t send_bytes)
+        socket_.async_write_some(response_buffers_,
+            make_custom_alloc_handler(buffer_->write_memory(),
+            [this, request_count](const boost::system::error_code & ec, std::size_t send_bytes)
             {
                 if (!ec) {
 #if 0
                     if (is_first_read) {
-                        std::cout << "g_response_html.size() = " << g_response_html.size() << std::endl;
+                        std::cout << "response_bytes_ = " << response_bytes_ << std::endl;
                         is_first_read = false;
                     }
 #endif
@@ -636,9 +792,10 @@ private:
                     do_send_counter((uint32_t)send_bytes);
 
                     // If get a circle of ping-pong, we count the query one time.
-                    do_query_counter_sync_write();
+                    do_query_counter_sync_write(request_count);
+                    do_heartbeat_counter();
 
-                    if ((uint32_t)send_bytes != g_response_html.size() && send_bytes != 0) {
+                    if (send_bytes != response_bytes_ && send_bytes != 0) {
                         std::cout << "asio_http_session::do_async_write_http_response_some(): async_write(), send_bytes = "
                                   << send_bytes << " bytes." << std::endl;
                     }
@@ -652,7 +809,7 @@ private:
                               << ec.message().c_str() << std::endl;
                     stop(true);
                 }
-            }
+            })
         );
     }
 
@@ -666,7 +823,8 @@ private:
                 buffer_size = PACKET_SIZE;
 #if 1
             // async write one time <= PACKET_SIZE
-            boost::asio::async_write(socket_, boost::asio::buffer(buffer_.data(), buffer_size),
+            boost::asio::async_write(socket_, boost::asio::buffer(buffer_->data(), buffer_size),
+                make_custom_alloc_handler(buffer_->write_memory(),
                 [this, buffer_size](const boost::system::error_code & ec, std::size_t send_bytes)
                 {
                     if (!ec) {
@@ -690,11 +848,12 @@ private:
                                   << ec.message().c_str() << std::endl;
                         stop(true);
                     }
-                }
+                })
             );
 #else
             // async write some one time <= PACKET_SIZE
-            socket_.async_write_some(boost::asio::buffer(buffer_.data(), buffer_size),
+            socket_.async_write_some(boost::asio::buffer(buffer_->data(), buffer_size),
+                make_custom_alloc_handler(buffer_->write_memory(),
                 [this, buffer_size](const boost::system::error_code & ec, std::size_t send_bytes)
                 {
                     if (!ec) {
@@ -717,7 +876,7 @@ private:
                                   << ec.message().c_str() << std::endl;
                         stop(true);
                     }
-                }
+                })
             );
 #endif
             total_send_bytes -= PACKET_SIZE;
@@ -726,9 +885,3 @@ private:
 };
 
 } // namespace asio_test
-
-#undef USE_ATOMIC_REALTIME_UPDATE
-#undef QUERY_COUNTER_INTERVAL
-
-#undef MAX_UPDATE_CNT
-#undef MAX_UPDATE_BYTES
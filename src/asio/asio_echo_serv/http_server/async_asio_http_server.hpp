@@ -2,6 +2,7 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 #include <thread>
 #include <functional>
 #include <boost/noncopyable.hpp>
@@ -13,7 +14,11 @@
 
 #include "../common.h"
 #include "../io_service_pool.hpp"
+#include "../socket_options.hpp"
+#include "../session_start_queue.hpp"
+#include "../accept_backoff.hpp"
 #include "asio_http_session.hpp"
+#include "http_response.hpp"
 
 using namespace boost::asio;
 
@@ -26,32 +31,51 @@ class async_asio_http_server : public boost::enable_shared_from_this<async_asio_
                                private boost::noncopyable
 {
 private:
+    typedef std::shared_ptr<boost::asio::ip::tcp::acceptor>  acceptor_ptr;
+    typedef std::shared_ptr<accept_backoff>  accept_backoff_ptr;
+    typedef std::shared_ptr< session_pool<asio_http_session> >  session_pool_ptr;
+    typedef std::shared_ptr<http_buffer_pool>  buffer_pool_ptr;
+
     io_service_pool					    io_service_pool_;
-    boost::asio::ip::tcp::acceptor	    acceptor_;
+    session_start_queue<asio_http_session>  start_queue_;
+    std::vector<buffer_pool_ptr>        buffer_pools_;
+    std::vector<session_pool_ptr>       session_pools_;
+    http_response_table                 responses_;
+    std::vector<acceptor_ptr>	        acceptors_;
+    std::vector<accept_backoff_ptr>     accept_backoffs_;
     std::shared_ptr<asio_http_session>	session_;
     std::shared_ptr<std::thread>	    thread_;
     uint32_t                            buffer_size_;
     uint32_t					        packet_size_;
+    bool                                reuse_port_;
+    uint32_t                            pending_accepts_;
 
 public:
     async_asio_http_server(const std::string & ip_addr, const std::string & port,
         uint32_t buffer_size = 65536,
         uint32_t packet_size = 64,
         uint32_t pool_size = std::thread::hardware_concurrency())
-        : io_service_pool_(pool_size), acceptor_(io_service_pool_.get_first_io_service()),
-          buffer_size_(buffer_size), packet_size_(packet_size)
+        : io_service_pool_(pool_size), start_queue_(io_service_pool_), buffer_size_(buffer_size), packet_size_(packet_size),
+          reuse_port_(g_reuse_port != 0), pending_accepts_(g_pending_accepts)
     {
+        io_service_pool_.set_cpu_affinity(g_cpu_list, (g_numa_local != 0));
+        io_service_pool_.set_busy_poll(g_busy_poll);
+        create_response_table();
+        create_session_pools();
         start(ip_addr, port);
     }
 
     async_asio_http_server(short port, uint32_t buffer_size = 65536,
         uint32_t packet_size = 64,
         uint32_t pool_size = std::thread::hardware_concurrency())
-        : io_service_pool_(pool_size),
-          acceptor_(io_service_pool_.get_first_io_service(), ip::tcp::endpoint(ip::tcp::v4(), port)),
-          buffer_size_(buffer_size), packet_size_(packet_size)
+        : io_service_pool_(pool_size), start_queue_(io_service_pool_), buffer_size_(buffer_size), packet_size_(packet_size),
+          reuse_port_(g_reuse_port != 0), pending_accepts_(g_pending_accepts)
     {
-        do_accept();
+        io_service_pool_.set_cpu_affinity(g_cpu_list, (g_numa_local != 0));
+        io_service_pool_.set_busy_poll(g_busy_poll);
+        create_response_table();
+        create_session_pools();
+        start(ip::tcp::endpoint(ip::tcp::v4(), port));
     }
 
     ~async_asio_http_server()
@@ -66,28 +90,104 @@ public:
         ip::tcp::resolver::iterator endpoint_iterator = resolver.resolve(query);
         boost::asio::ip::tcp::endpoint endpoint = *resolver.resolve(query);
 
-        boost::system::error_code ec;
-        acceptor_.open(endpoint.protocol(), ec);
-        if (ec) {
-            // Open endpoint error
-            std::cout << "async_asio_http_server::start() - Error: (code = " << ec.value() << ") "
-                      << ec.message().c_str() << std::endl;
-            return;
+        start(endpoint);
+    }
+
+    void start(const boost::asio::ip::tcp::endpoint & endpoint)
+    {
+#if !HAS_SOCKET_REUSE_PORT
+        if (reuse_port_) {
+            std::cout << "async_asio_http_server::start() - Warning: SO_REUSEPORT is not supported, "
+                      << "use the single acceptor instead." << std::endl;
+            reuse_port_ = false;
         }
+#endif
+        // If SO_REUSEPORT is enabled, every io_service owns its listener, the kernel spreads
+        // the new connections among them and the sessions never leave the accepted thread.
+        std::size_t acceptor_count = (reuse_port_) ? io_service_pool_.size() : 1;
+        for (std::size_t i = 0; i < acceptor_count; ++i) {
+            acceptor_ptr acceptor = std::make_shared<boost::asio::ip::tcp::acceptor>(
+                io_service_pool_.get_io_service(i));
+
+            boost::system::error_code ec;
+            acceptor->open(endpoint.protocol(), ec);
+            if (ec) {
+                // Open endpoint error
+                std::cout << "async_asio_http_server::start() - Error: (code = " << ec.value() << ") "
+                          << ec.message().c_str() << std::endl;
+                return;
+            }
 
-        boost::asio::socket_base::reuse_address option(true);
-        acceptor_.set_option(option);
-        acceptor_.bind(endpoint);
-        acceptor_.listen();
+            boost::asio::socket_base::reuse_address option(true);
+            acceptor->set_option(option);
+#if HAS_SOCKET_REUSE_PORT
+            if (reuse_port_) {
+                acceptor->set_option(reuse_port(true), ec);
+                if (ec) {
+                    std::cout << "async_asio_http_server::start() - Error: (code = " << ec.value() << ") "
+                              << ec.message().c_str() << std::endl;
+                    return;
+                }
+            }
+#endif
+            acceptor->bind(endpoint);
+            acceptor->listen();
 
-        do_accept();
+            acceptors_.push_back(acceptor);
+            accept_backoffs_.push_back(std::make_shared<accept_backoff>(io_service_pool_.get_io_service(i)));
+        }
+
+        // Keep pending_accepts accepts pending on every acceptor, every one re-arms itself,
+        // so a burst of new connections is accepted by one wake-up of the reactor.
+        for (std::size_t i = 0; i < acceptors_.size(); ++i) {
+            for (uint32_t j = 0; j < pending_accepts_; ++j) {
+                do_accept(i);
+            }
+        }
     }
 
     void stop()
     {
-        acceptor_.cancel();
+        for (std::size_t i = 0; i < acceptors_.size(); ++i) {
+            acceptors_[i]->cancel();
+            accept_backoffs_[i]->cancel();
+        }
+    }
+
+    uint64_t session_pool_hits() const
+    {
+        uint64_t hits = 0;
+        for (std::size_t i = 0; i < session_pools_.size(); ++i) {
+            hits += session_pools_[i]->hits();
+        }
+        return hits;
+    }
+
+    uint64_t session_pool_misses() const
+    {
+        uint64_t misses = 0;
+        for (std::size_t i = 0; i < session_pools_.size(); ++i) {
+            misses += session_pools_[i]->misses();
+        }
+        return misses;
+    }
+
+    uint64_t buffer_pool_misses() const
+    {
+        uint64_t misses = 0;
+        for (std::size_t i = 0; i < buffer_pools_.size(); ++i) {
+            misses += buffer_pools_[i]->misses();
+        }
+        return misses;
     }
 
+    /// The per io_service statistics, for the stats endpoint.
+    std::size_t io_service_count() const { return io_service_pool_.size(); }
+    int thread_id(std::size_t index) const { return io_service_pool_.get_thread_id(index); }
+    std::size_t start_queue_size(std::size_t index) { return start_queue_.size(index); }
+    std::size_t free_sessions(std::size_t index) { return session_pools_[index]->size(); }
+    std::size_t free_buffers(std::size_t index) { return buffer_pools_[index]->size(); }
+
     void run()
     {
         thread_ = std::make_shared<std::thread>([this] { io_service_pool_.run(); });
@@ -100,36 +200,94 @@ public:
     }
 
 private:
-    void handle_accept(const boost::system::error_code & ec, asio_http_session * session)
+    void create_response_table()
+    {
+        // The routes have been checked by the command line parser.
+        for (std::size_t i = 0; i < g_http_routes.size(); ++i) {
+            responses_.add_route(g_http_routes[i]);
+        }
+        if (responses_.size() == 0)
+            responses_.add_hello_world();
+    }
+
+    void create_session_pools()
+    {
+        // One session pool per io_service, the sessions can only be recycled in their own io_service.
+        // The ring buffers are pooled in the same way, they are only held by the busy sessions.
+        for (std::size_t i = 0; i < io_service_pool_.size(); ++i) {
+            buffer_pools_.push_back(std::make_shared<http_buffer_pool>(g_session_pool_size));
+            session_pools_.push_back(std::make_shared< session_pool<asio_http_session> >(g_session_pool_size));
+        }
+    }
+
+    void handle_accept(const boost::system::error_code & ec, asio_http_session * session, std::size_t index,
+                       std::size_t service_index)
     {
         if (!ec) {
+            g_accept_count.fetch_add(1, std::memory_order_relaxed);
+            accept_backoffs_[index]->reset();
             if (session) {
-                session->start();
+                start_session(session, service_index);
             }
-            do_accept();
+            do_accept(index);
         }
         else {
-            // Accept error
-            std::cout << "async_asio_http_server::handle_accept() - Error: (code = " << ec.value() << ") "
-                      << ec.message().c_str() << std::endl;
+            // The session was never started, give it back to the pool.
             if (session) {
-                session->stop();
-                delete session;
+                session_pools_[service_index]->release(session);
             }
-        }        
+            if (ec == boost::asio::error::operation_aborted) {
+                // The acceptor is stopped.
+                return;
+            }
+            if (accept_backoff::is_retryable_now(ec)) {
+                do_accept(index);
+                return;
+            }
+
+            // Accept error, such as EMFILE: retry it later instead of stopping the listener.
+            accept_backoff & backoff = *accept_backoffs_[index];
+            if (backoff.defer([this, index]() { do_accept(index); })) {
+                std::cout << "async_asio_http_server::handle_accept() - Error: (code = " << ec.value() << ") "
+                          << ec.message().c_str() << ", retry in " << backoff.delay() << " ms" << std::endl;
+            }
+        }
+    }
+
+    void start_session(asio_http_session * session, std::size_t service_index)
+    {
+        // With SO_REUSEPORT, the session is accepted in its own thread and started at once.
+        if (reuse_port_)
+            session->start();
+        else
+            start_queue_.push(session, service_index);
+    }
+
+    std::size_t get_session_index(std::size_t index)
+    {
+        // With SO_REUSEPORT, the session stays in the io_service of its acceptor,
+        // otherwise the sessions are dispatched to the io_services by round-robin.
+        if (reuse_port_)
+            return index;
+        else
+            return io_service_pool_.get_next_index();
     }
 
-    void do_accept()
+    void do_accept(std::size_t index)
     {
-        asio_http_session * new_session = new asio_http_session(io_service_pool_.get_io_service(), buffer_size_, packet_size_, g_test_mode);
-        acceptor_.async_accept(new_session->socket(), boost::bind(&async_asio_http_server::handle_accept,
-            this, boost::asio::placeholders::error, new_session));
+        std::size_t service_index = get_session_index(index);
+        asio_http_session * new_session = session_pools_[service_index]->acquire(
+            io_service_pool_.get_io_service(service_index), buffer_size_, packet_size_, g_test_mode,
+            session_pools_[service_index].get(), &responses_, buffer_pools_[service_index].get());
+        acceptors_[index]->async_accept(new_session->socket(), boost::bind(&async_asio_http_server::handle_accept,
+            this, boost::asio::placeholders::error, new_session, index, service_index));
     }
 
     void do_accept2()
     {
-        session_.reset(new asio_http_session(io_service_pool_.get_io_service(), buffer_size_, packet_size_, g_test_mode));
-        acceptor_.async_accept(session_->socket(),
+        session_.reset(new asio_http_session(io_service_pool_.get_io_service(get_session_index(0)),
+                                      buffer_size_, packet_size_, g_test_mode, nullptr, &responses_));
+        acceptors_[0]->async_accept(session_->socket(),
             [this](const boost::system::error_code & ec)
             {
                 if (!ec) {
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <boost/noncopyable.hpp>
+
+#include "../common.h"
+#include "common/cmd_utils.hpp"
+
+namespace asio_test {
+
+//
+// The "Date: ...\r\n\r\n" line which ends the response header, it's rebuilt at most
+// once per second in every io_service thread, the hot path only compares the time.
+//
+class http_date_cache {
+public:
+    // "Date: Fri, 31 Aug 2016 16:25:26 GMT\r\n\r\n"
+    enum { kDateLineSize = 6 + 29 + 4 };
+
+private:
+    struct date_line_t {
+        time_t  last_time;
+        char    line[kDateLineSize + 1];
+    };
+
+public:
+    static const char * get()
+    {
+        static thread_local date_line_t date_line = { (time_t)-1, { 0 } };
+        time_t now = ::time(nullptr);
+        if (now != date_line.last_time) {
+            format_date_line(now, date_line.line);
+            date_line.last_time = now;
+        }
+        return date_line.line;
+    }
+
+private:
+    static void format_date_line(time_t now, char * line)
+    {
+        struct tm gmt;
+#if defined(_MSC_VER)
+        ::gmtime_s(&gmt, &now);
+#else
+        ::gmtime_r(&now, &gmt);
+#endif
+        ::strftime(line, kDateLineSize + 1, "Date: %a, %d %b %Y %H:%M:%S GMT\r\n\r\n", &gmt);
+    }
+};
+
+//
+// A prebuilt response, every field except the Date line is formatted once when the
+// route is added, a response is sent as three buffers: head, date line and body.
+//
+struct http_route {
+    // The request path, "*" matches any path.
+    std::string path;
+    // The status line and the header fields, without the Date line and the blank line.
+    std::string head;
+    std::string body;
+};
+
+class http_response_table : private boost::noncopyable {
+private:
+    std::vector<http_route> routes_;
+    // Point to the "*" route, or the 404 route if there isn't any.
+    const http_route *      default_route_;
+    http_route              not_found_;
+
+public:
+    explicit http_response_table(bool hello_world = false) : default_route_(nullptr)
+    {
+        build_route(not_found_, "*", 404, "text/plain", "Not Found", std::vector<std::string>());
+        default_route_ = &not_found_;
+        if (hello_world)
+            add_hello_world();
+    }
+
+    ~http_response_table() {}
+
+    static const http_response_table & default_table()
+    {
+        static const http_response_table table(true);
+        return table;
+    }
+
+    std::size_t size() const { return routes_.size(); }
+    const std::vector<http_route> & routes() const { return routes_; }
+
+    void add_route(const std::string & path, uint32_t status, const std::string & content_type,
+                   const std::string & body, const std::vector<std::string> & headers)
+    {
+        http_route route;
+        build_route(route, path, status, content_type, body, headers);
+        routes_.push_back(route);
+        update_default_route();
+    }
+
+    void add_hello_world()
+    {
+        add_route("*", 200, "text/html", "Hello World!", std::vector<std::string>());
+    }
+
+    //
+    // Parse a route spec: "path|status|content-type|body[|header: value]...",
+    // if the body starts with '@', it's the name of the file to load the body from.
+    //
+    // For example: "/|200|text/html|Hello World!" or "/index.html|200|text/html|@index.html|Cache-Control: no-cache"
+    //
+    bool add_route(const std::string & spec)
+    {
+        std::vector<std::string> fields;
+        std::string::size_type first = 0, last;
+        while ((last = spec.find('|', first)) != std::string::npos) {
+            fields.push_back(spec.substr(first, last - first));
+            first = last + 1;
+        }
+        fields.push_back(spec.substr(first));
+        if (fields.size() < 4 || fields[0].empty())
+            return false;
+
+        unsigned int status = 0;
+        if (parse_number_u32(fields[1], status) != (int)fields[1].size() || status < 100 || status > 999)
+            return false;
+
+        std::string body = fields[3];
+        if (!body.empty() && body[0] == '@') {
+            std::ifstream ifs(body.substr(1).c_str(), std::ios::in | std::ios::binary);
+            if (!ifs.is_open())
+                return false;
+            std::ostringstream oss;
+            oss << ifs.rdbuf();
+            body = oss.str();
+        }
+
+        std::vector<std::string> headers(fields.begin() + 4, fields.end());
+        add_route(fields[0], status, fields[2], body, headers);
+        return true;
+    }
+
+    /// Find the route of a request, the request is [request, request + length).
+    const http_route & match(const char * request, std::size_t length) const
+    {
+        // Only a "*" route, needn't to look at the request.
+        if (routes_.size() == 1 && default_route_ == &routes_[0])
+            return *default_route_;
+
+        // The request line: "METHOD SP request-target SP HTTP-version"
+        const char * end = request + length;
+        const char * path = (const char *)::memchr(request, ' ', length);
+        if (path != nullptr) {
+            path++;
+            const char * path_end = path;
+            while (path_end < end && *path_end != ' ' && *path_end != '?' && *path_end != '\r')
+                path_end++;
+            std::size_t path_len = (std::size_t)(path_end - path);
+            for (std::size_t i = 0; i < routes_.size(); ++i) {
+                const std::string & route_path = routes_[i].path;
+                if (route_path.size() == path_len && ::memcmp(route_path.c_str(), path, path_len) == 0)
+                    return routes_[i];
+            }
+        }
+        return *default_route_;
+    }
+
+private:
+    void update_default_route()
+    {
+        default_route_ = &not_found_;
+        for (std::size_t i = 0; i < routes_.size(); ++i) {
+            if (routes_[i].path == "*") {
+                default_route_ = &routes_[i];
+                break;
+            }
+        }
+    }
+
+    static const char * get_reason_phrase(uint32_t status)
+    {
+        switch (status) {
+        case 200: return "OK";
+        case 201: return "Created";
+        case 204: return "No Content";
+        case 301: return "Moved Permanently";
+        case 302: return "Found";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 500: return "Internal Server Error";
+        case 503: return "Service Unavailable";
+        default:  return "Unknown";
+        }
+    }
+
+    static void build_route(http_route & route, const std::string & path, uint32_t status,
+                            const std::string & content_type, const std::string & body,
+                            const std::vector<std::string> & headers)
+    {
+        route.path = path;
+        route.body = body;
+
+        std::ostringstream head;
+        head << "HTTP/1.1 " << status << " " << get_reason_phrase(status) << "\r\n"
+             << "Server: boost-asio\r\n";
+        if (!content_type.empty())
+            head << "Content-Type: " << content_type << "\r\n";
+        head << "Content-Length: " << body.size() << "\r\n"
+             << "Connection: Keep-Alive\r\n";
+        for (std::size_t i = 0; i < headers.size(); ++i) {
+            if (!headers[i].empty())
+                head << headers[i] << "\r\n";
+        }
+        route.head = head.str();
+    }
+};
+
+} // namespace asio_test
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__x86_64__) || defined(__amd64__) \
+ || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)) || defined(__SSE2__)
+#define HTTP_SCANNER_USE_SSE2   1
+#include <emmintrin.h>
+#else
+#define HTTP_SCANNER_USE_SSE2   0
+#endif
+
+#if HTTP_SCANNER_USE_SSE2 && (defined(_MSC_VER) || defined(__GNUC__) || defined(__clang__))
+#define HTTP_SCANNER_USE_AVX2   1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#else
+#define HTTP_SCANNER_USE_AVX2   0
+#endif
+
+#if HTTP_SCANNER_USE_AVX2 && !defined(_MSC_VER)
+#define HTTP_SCANNER_TARGET_AVX2    __attribute__((target("avx2")))
+#else
+#define HTTP_SCANNER_TARGET_AVX2
+#endif
+
+namespace asio_test {
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// Find the end of every http request header ("\r\n\r\n") in one pass.
+//
+// The kernels only look for the line breaks ('\n'), SSE2 / AVX2 compare 16 / 32 bytes
+// at a time, and every line break is checked backward whether it ends an empty line.
+// Because the check only looks backward, every byte before length has been fully
+// examined when the scan returns, the next scan can resume at the old length.
+//
+// data:       the begin of the first unconsumed request.
+// start:      the offset to resume scanning from, the bytes before it have been scanned.
+// length:     the bytes of the data.
+// boundaries: appended with the end offset of every complete request header.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+class http_scanner {
+public:
+    typedef void (*scan_func_t)(const char * data, std::size_t start, std::size_t length,
+                                std::vector<uint32_t> & boundaries);
+
+    static void scan(const char * data, std::size_t start, std::size_t length,
+                     std::vector<uint32_t> & boundaries)
+    {
+        static const scan_func_t scan_func = select_scan_func();
+        scan_func(data, start, length, boundaries);
+    }
+
+    static const char * kernel_name()
+    {
+#if HTTP_SCANNER_USE_AVX2
+        if (cpu_has_avx2())
+            return "avx2";
+#endif
+#if HTTP_SCANNER_USE_SSE2
+        return "sse2";
+#else
+        return "scalar";
+#endif
+    }
+
+    static void scan_scalar(const char * data, std::size_t start, std::size_t length,
+                            std::vector<uint32_t> & boundaries)
+    {
+        const char * cur = data + start;
+        const char * end = data + length;
+        while (cur < end) {
+            cur = (const char *)::memchr(cur, '\n', (std::size_t)(end - cur));
+            if (cur == nullptr)
+                break;
+            check_line_break(data, (std::size_t)(cur - data), boundaries);
+            cur++;
+        }
+    }
+
+#if HTTP_SCANNER_USE_SSE2
+    static void scan_sse2(const char * data, std::size_t start, std::size_t length,
+                          std::vector<uint32_t> & boundaries)
+    {
+        const __m128i line_feed = _mm_set1_epi8('\n');
+        std::size_t pos = start;
+        while ((pos + 16) <= length) {
+            __m128i chunk = _mm_loadu_si128((const __m128i *)(data + pos));
+            uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, line_feed));
+            while (mask != 0) {
+                check_line_break(data, pos + count_trailing_zeros(mask), boundaries);
+                mask &= (mask - 1);
+            }
+            pos += 16;
+        }
+        scan_scalar(data, pos, length, boundaries);
+    }
+#endif // HTTP_SCANNER_USE_SSE2
+
+#if HTTP_SCANNER_USE_AVX2
+    HTTP_SCANNER_TARGET_AVX2
+    static void scan_avx2(const char * data, std::size_t start, std::size_t length,
+                          std::vector<uint32_t> & boundaries)
+    {
+        const __m256i line_feed = _mm256_set1_epi8('\n');
+        std::size_t pos = start;
+        while ((pos + 32) <= length) {
+            __m256i chunk = _mm256_loadu_si256((const __m256i *)(data + pos));
+            uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, line_feed));
+            while (mask != 0) {
+                check_line_break(data, pos + count_trailing_zeros(mask), boundaries);
+                mask &= (mask - 1);
+            }
+            pos += 32;
+        }
+        scan_scalar(data, pos, length, boundaries);
+    }
+#endif // HTTP_SCANNER_USE_AVX2
+
+private:
+    static inline void check_line_break(const char * data, std::size_t pos,
+                                        std::vector<uint32_t> & boundaries)
+    {
+        // The terminator can't begin before the current request.
+        std::size_t request_begin = boundaries.empty() ? 0 : boundaries.back();
+        if (pos >= (request_begin + 3) && data[pos - 1] == '\r'
+            && data[pos - 2] == '\n' && data[pos - 3] == '\r') {
+            boundaries.push_back((uint32_t)(pos + 1));
+        }
+    }
+
+    static inline uint32_t count_trailing_zeros(uint32_t mask)
+    {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanForward(&index, mask);
+        return (uint32_t)index;
+#elif defined(__GNUC__) || defined(__clang__)
+        return (uint32_t)__builtin_ctz(mask);
+#else
+        uint32_t index = 0;
+        while ((mask & 1) == 0) {
+            mask >>= 1;
+            index++;
+        }
+        return index;
+#endif
+    }
+
+    static bool cpu_has_avx2()
+    {
+#if HTTP_SCANNER_USE_AVX2
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+        __cpuid(info, 1);
+        // OSXSAVE and AVX, the OS must save the YMM registers too.
+        if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0)
+            return false;
+        if ((_xgetbv(0) & 0x06) != 0x06)
+            return false;
+        __cpuidex(info, 7, 0);
+        return ((info[1] & (1 << 5)) != 0);
+#else
+        __builtin_cpu_init();
+        return (__builtin_cpu_supports("avx2") != 0);
+#endif
+#else
+        return false;
+#endif // HTTP_SCANNER_USE_AVX2
+    }
+
+    static scan_func_t select_scan_func()
+    {
+#if HTTP_SCANNER_USE_AVX2
+        if (cpu_has_avx2())
+            return &http_scanner::scan_avx2;
+#endif
+#if HTTP_SCANNER_USE_SSE2
+        return &http_scanner::scan_sse2;
+#else
+        return &http_scanner::scan_scalar;
+#endif
+    }
+};
+
+} // namespace asio_test
+
+#undef HTTP_SCANNER_TARGET_AVX2
@@ -1,12 +1,19 @@
 
 #pragma once
 
+#include <iostream>
 #include <atomic>
+#include <memory>
+#include <vector>
 #include <boost/noncopyable.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
 #include <boost/asio/io_service.hpp>
 
+#include "cpu_affinity.hpp"
+#include "common/busy_poll.hpp"
+#include "common/process_stats.hpp"
+
 using namespace boost::asio;
 
 namespace asio_test {
@@ -25,14 +32,29 @@ private:
     /// The next io_service to use for a connection.
     std::atomic<uint32_t> next_io_service_;
 
+    /// The cpus which the io_service threads bind to, empty means no binding.
+    std::vector<int> cpu_list_;
+
+    /// Whether the memory of each io_service thread is allocated on its local NUMA node.
+    bool numa_local_;
+
+    /// The microseconds to spin on poll() before blocking in run_one(), 0 is the normal run().
+    uint32_t spin_us_;
+
+    /// The kernel thread ids of the io_service threads, 0 before the threads are started.
+    std::unique_ptr< std::atomic<int>[] > thread_ids_;
+
 public:
     /// Construct the io_service pool.
     explicit io_service_pool(uint32_t pool_size)
-        : next_io_service_(0)
+        : next_io_service_(0), numa_local_(false), spin_us_(0), thread_ids_(new std::atomic<int>[pool_size])
     {
         if (pool_size == 0)
             throw std::runtime_error("io_service_pool size is 0.");
 
+        for (uint32_t i = 0; i < pool_size; ++i)
+            thread_ids_[i].store(0, std::memory_order_relaxed);
+
         // Give all the io_services work to do so that their run() functions will not
         // exit until they are explicitly stopped.
         for (uint32_t i = 0; i < pool_size; ++i) {
@@ -48,6 +70,19 @@ public:
         stop();
     }
 
+    /// Bind the io_service threads to the cpus, must be called before run().
+    void set_cpu_affinity(const std::vector<int> & cpu_list, bool numa_local)
+    {
+        cpu_list_ = cpu_list;
+        numa_local_ = numa_local;
+    }
+
+    /// Spin-then-park the io_service threads, must be called before run().
+    void set_busy_poll(uint32_t spin_us)
+    {
+        spin_us_ = spin_us;
+    }
+
     /// Run all io_service objects in the pool.
     void run()
     {
@@ -56,7 +91,7 @@ public:
         for (std::size_t i = 0; i < io_services_.size(); ++i)
         {
             boost::shared_ptr<boost::thread> thread(new boost::thread(
-                boost::bind(&boost::asio::io_service::run, io_services_[i])));
+                boost::bind(&io_service_pool::run_io_service, this, i)));
             threads.push_back(thread);
         }
 
@@ -73,6 +108,31 @@ public:
             io_services_[i]->stop();
     }
 
+    /// Get the number of io_services in the pool.
+    std::size_t size() const
+    {
+        return io_services_.size();
+    }
+
+    /// Get the kernel thread id of the io_service thread at the specified index.
+    int get_thread_id(std::size_t index) const
+    {
+        return thread_ids_[index].load(std::memory_order_relaxed);
+    }
+
+    /// Get the io_service at the specified index.
+    boost::asio::io_service & get_io_service(std::size_t index)
+    {
+        return *io_services_[index];
+    }
+
+    /// Get the index of the next io_service to use.
+    std::size_t get_next_index()
+    {
+        // Use a round-robin scheme to choose the next io_service to use.
+        return (next_io_service_.fetch_add(1) % io_services_.size());
+    }
+
     /// Get an io_service to use.
     boost::asio::io_service & get_io_service()
     {
@@ -101,6 +161,30 @@ public:
         boost::asio::io_service & io_service = *io_services_[0];
         return io_service;
     }
+
+private:
+    /// The thread function of each io_service.
+    void run_io_service(std::size_t index)
+    {
+        thread_ids_[index].store(process_stats::current_thread_id(), std::memory_order_relaxed);
+
+        if (!cpu_list_.empty()) {
+            // If there are more threads than cpus, wrap around the cpu list.
+            int cpu = cpu_list_[index % cpu_list_.size()];
+            if (!bind_thread_to_cpu(cpu)) {
+                std::cout << "io_service_pool::run_io_service() - Error: can not bind thread "
+                          << index << " to cpu " << cpu << "." << std::endl;
+            }
+            else if (numa_local_) {
+                int node = get_cpu_numa_node(cpu);
+                if (!bind_thread_memory_to_node(node)) {
+                    std::cout << "io_service_pool::run_io_service() - Error: can not bind thread "
+                              << index << " memory to NUMA node " << node << "." << std::endl;
+                }
+            }
+        }
+        run_spin_then_park(*io_services_[index], spin_us_);
+    }
 };
 
 } // namespace asio_test
@@ -0,0 +1,511 @@
+#pragma once
+
+// The multishot recv, the provided buffer rings and IORING_SETUP_DEFER_TASKRUN need
+// the kernel headers of Linux 6.1+, the older <linux/io_uring.h> doesn't define them.
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#if defined(IORING_SETUP_DEFER_TASKRUN) && defined(IORING_RECV_MULTISHOT)
+#define HAS_IO_URING    1
+#endif
+#endif
+#endif
+
+#ifndef HAS_IO_URING
+#define HAS_IO_URING    0
+#endif
+
+#if HAS_IO_URING
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <boost/noncopyable.hpp>
+
+namespace asio_test {
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// A minimal io_uring, set up by the raw system calls (no liburing):
+//
+//   io_uring_setup()    : create the ring, the SQ / CQ rings and the SQE array are
+//                         mapped into the user space.
+//   io_uring_enter()    : submit all of the queued SQEs and wait for the completions
+//                         by one system call.
+//   io_uring_register() : register the sparse fixed file table and the provided
+//                         buffer rings.
+//
+// The ring is owned by one thread, it must be created by the thread which submits to it
+// (IORING_SETUP_SINGLE_ISSUER and IORING_SETUP_DEFER_TASKRUN if the kernel supports them).
+//
+// The methods return 0 (or a count) on success and -errno on failure, as the kernel does.
+//
+// See: https://man7.org/linux/man-pages/man7/io_uring.7.html
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+class io_uring_ring : private boost::noncopyable {
+private:
+    int         ring_fd_;
+    uint32_t    setup_flags_;
+    uint32_t    features_;
+
+    // The submission queue, sq_tail_local_ is the tail of the SQEs which are not submitted yet.
+    uint32_t *  sq_head_;
+    uint32_t *  sq_tail_;
+    uint32_t    sq_mask_;
+    uint32_t    sq_entries_;
+    uint32_t    sq_tail_local_;
+    uint32_t    sq_submitted_;
+    struct io_uring_sqe * sqes_;
+
+    // The completion queue.
+    uint32_t *  cq_head_;
+    uint32_t *  cq_tail_;
+    uint32_t    cq_mask_;
+    struct io_uring_cqe * cqes_;
+
+    void *      sq_ring_ptr_;
+    std::size_t sq_ring_size_;
+    void *      cq_ring_ptr_;
+    std::size_t cq_ring_size_;
+    std::size_t sqes_size_;
+
+    // The count of io_uring_enter() calls, to compare the system calls with the epoll reactor.
+    uint64_t    enter_count_;
+
+public:
+    io_uring_ring()
+        : ring_fd_(-1), setup_flags_(0), features_(0),
+          sq_head_(nullptr), sq_tail_(nullptr), sq_mask_(0), sq_entries_(0), sq_tail_local_(0), sq_submitted_(0),
+          sqes_(nullptr), cq_head_(nullptr), cq_tail_(nullptr), cq_mask_(0), cqes_(nullptr),
+          sq_ring_ptr_(MAP_FAILED), sq_ring_size_(0), cq_ring_ptr_(MAP_FAILED), cq_ring_size_(0),
+          sqes_size_(0), enter_count_(0)
+    {
+    }
+
+    ~io_uring_ring()
+    {
+        close();
+    }
+
+    int fd() const { return ring_fd_; }
+    uint32_t setup_flags() const { return setup_flags_; }
+    uint32_t features() const { return features_; }
+    uint64_t enter_count() const { return enter_count_; }
+
+    /// Whether the kernel supports the io_uring features used by the engine, see below.
+    static bool is_supported();
+
+    int init(uint32_t entries, uint32_t cq_entries)
+    {
+        // Prefer the single issuer ring which runs the completion work only when we enter
+        // the kernel to wait for it, fall back to a plain ring on the older kernels.
+        static const uint32_t kSetupFlagsList[] = {
+            IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN | IORING_SETUP_SUBMIT_ALL,
+            IORING_SETUP_SUBMIT_ALL,
+            0
+        };
+
+        int ret = -EINVAL;
+        for (std::size_t i = 0; i < sizeof(kSetupFlagsList) / sizeof(kSetupFlagsList[0]); ++i) {
+            struct io_uring_params params;
+            ::memset(&params, 0, sizeof(params));
+            params.flags = kSetupFlagsList[i] | IORING_SETUP_CQSIZE;
+            params.cq_entries = cq_entries;
+            ret = (int)::syscall(__NR_io_uring_setup, entries, &params);
+            if (ret >= 0) {
+                ring_fd_ = ret;
+                setup_flags_ = params.flags;
+                features_ = params.features;
+                return map_rings(params);
+            }
+            ret = -errno;
+            if (ret != -EINVAL)
+                break;
+        }
+        return ret;
+    }
+
+    void close()
+    {
+        if (sqes_ != nullptr) {
+            ::munmap(sqes_, sqes_size_);
+            sqes_ = nullptr;
+        }
+        if (cq_ring_ptr_ != MAP_FAILED && cq_ring_ptr_ != sq_ring_ptr_)
+            ::munmap(cq_ring_ptr_, cq_ring_size_);
+        cq_ring_ptr_ = MAP_FAILED;
+        if (sq_ring_ptr_ != MAP_FAILED)
+            ::munmap(sq_ring_ptr_, sq_ring_size_);
+        sq_ring_ptr_ = MAP_FAILED;
+        if (ring_fd_ >= 0) {
+            ::close(ring_fd_);
+            ring_fd_ = -1;
+        }
+    }
+
+    /// Get a cleared SQE, the queued SQEs are submitted first if the SQ ring is full.
+    struct io_uring_sqe * get_sqe()
+    {
+        uint32_t head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        if ((sq_tail_local_ - head) >= sq_entries_) {
+            if (submit(0) < 0)
+                return nullptr;
+            head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+            if ((sq_tail_local_ - head) >= sq_entries_)
+                return nullptr;
+        }
+        struct io_uring_sqe * sqe = &sqes_[sq_tail_local_ & sq_mask_];
+        sq_tail_local_++;
+        ::memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    /// Submit all of the queued SQEs, and wait for wait_nr completions, by one io_uring_enter().
+    int submit(uint32_t wait_nr)
+    {
+        uint32_t to_submit = sq_tail_local_ - sq_submitted_;
+        if (to_submit > 0) {
+            __atomic_store_n(sq_tail_, sq_tail_local_, __ATOMIC_RELEASE);
+            sq_submitted_ = sq_tail_local_;
+        }
+
+        // The completions of a IORING_SETUP_DEFER_TASKRUN ring are only posted when we enter
+        // the kernel with IORING_ENTER_GETEVENTS, even if we don't wait for them.
+        bool defer_taskrun = ((setup_flags_ & IORING_SETUP_DEFER_TASKRUN) != 0);
+        uint32_t flags = 0;
+        if (wait_nr > 0 || defer_taskrun)
+            flags |= IORING_ENTER_GETEVENTS;
+        if (to_submit == 0 && wait_nr == 0 && !defer_taskrun)
+            return 0;
+
+        enter_count_++;
+        int ret = (int)::syscall(__NR_io_uring_enter, ring_fd_, to_submit, wait_nr, flags, nullptr, 0);
+        return ((ret >= 0) ? ret : -errno);
+    }
+
+    /// Call handler(cqe) for every available completion, return the count of them.
+    template <typename Handler>
+    uint32_t for_each_cqe(Handler && handler)
+    {
+        uint32_t head = *cq_head_;
+        uint32_t tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        uint32_t count = tail - head;
+        while (head != tail) {
+            handler(cqes_[head & cq_mask_]);
+            head++;
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+        return count;
+    }
+
+    /// Register a sparse fixed file table, the accepted sockets are installed into it directly.
+    int register_files_sparse(uint32_t nr_files)
+    {
+        struct io_uring_rsrc_register reg;
+        ::memset(&reg, 0, sizeof(reg));
+        reg.nr = nr_files;
+        reg.flags = IORING_RSRC_REGISTER_SPARSE;
+        return do_register(IORING_REGISTER_FILES2, &reg, sizeof(reg));
+    }
+
+    /// Whether the opcode is supported by the kernel, by IORING_REGISTER_PROBE.
+    bool is_op_supported(uint8_t opcode)
+    {
+        static const uint32_t kMaxOps = 256;
+        char probe_buffer[sizeof(struct io_uring_probe) + kMaxOps * sizeof(struct io_uring_probe_op)];
+        ::memset(probe_buffer, 0, sizeof(probe_buffer));
+        struct io_uring_probe * probe = (struct io_uring_probe *)probe_buffer;
+        if (do_register(IORING_REGISTER_PROBE, probe, kMaxOps) < 0)
+            return false;
+        if (opcode > probe->last_op)
+            return false;
+        return ((probe->ops[opcode].flags & IO_URING_OP_SUPPORTED) != 0);
+    }
+
+    /// Register a provided buffer ring as the buffer group bgid.
+    int register_buffer_ring(void * buf_ring, uint32_t entries, uint16_t bgid)
+    {
+        struct io_uring_buf_reg reg;
+        ::memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = (uint64_t)(uintptr_t)buf_ring;
+        reg.ring_entries = entries;
+        reg.bgid = bgid;
+        return do_register(IORING_REGISTER_PBUF_RING, &reg, 1);
+    }
+
+    //
+    // The SQE preparations.
+    //
+
+    /// Multishot accept, the new sockets are allocated from the fixed file table.
+    static void prep_multishot_accept_direct(struct io_uring_sqe * sqe, int listen_fd, uint64_t user_data)
+    {
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = listen_fd;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->file_index = IORING_FILE_INDEX_ALLOC;
+        sqe->user_data = user_data;
+    }
+
+    /// Multishot recv of a fixed file, every completion picks a buffer of the buffer group.
+    static void prep_multishot_recv(struct io_uring_sqe * sqe, uint32_t file_index, uint16_t bgid, uint64_t user_data)
+    {
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = (int32_t)file_index;
+        sqe->flags = IOSQE_FIXED_FILE | IOSQE_BUFFER_SELECT;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->buf_group = bgid;
+        sqe->user_data = user_data;
+    }
+
+    static void prep_sendmsg(struct io_uring_sqe * sqe, uint32_t file_index, const struct msghdr * msg, uint64_t user_data)
+    {
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = (int32_t)file_index;
+        sqe->flags = IOSQE_FIXED_FILE;
+        sqe->addr = (uint64_t)(uintptr_t)msg;
+        sqe->len = 1;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = user_data;
+    }
+
+    /// Cancel the request of user_data, a multishot request completes with -ECANCELED.
+    static void prep_cancel(struct io_uring_sqe * sqe, uint64_t target_user_data, uint64_t user_data)
+    {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = target_user_data;
+        sqe->user_data = user_data;
+    }
+
+    static void prep_shutdown(struct io_uring_sqe * sqe, uint32_t file_index, uint64_t user_data)
+    {
+        sqe->opcode = IORING_OP_SHUTDOWN;
+        sqe->fd = (int32_t)file_index;
+        sqe->flags = IOSQE_FIXED_FILE;
+        sqe->len = SHUT_RDWR;
+        sqe->user_data = user_data;
+    }
+
+    /// Close a fixed file, the slot can be allocated by the next accept after it completes.
+    static void prep_close_direct(struct io_uring_sqe * sqe, uint32_t file_index, uint64_t user_data)
+    {
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->file_index = file_index + 1;
+        sqe->user_data = user_data;
+    }
+
+    static void prep_multishot_poll(struct io_uring_sqe * sqe, int fd, uint32_t poll_mask, uint64_t user_data)
+    {
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        sqe->len = IORING_POLL_ADD_MULTI;
+        sqe->poll32_events = poll_mask;
+        sqe->user_data = user_data;
+    }
+
+private:
+    int do_register(uint32_t opcode, void * arg, uint32_t nr_args)
+    {
+        int ret = (int)::syscall(__NR_io_uring_register, ring_fd_, opcode, arg, nr_args);
+        return ((ret >= 0) ? ret : -errno);
+    }
+
+    int map_rings(const struct io_uring_params & params)
+    {
+        sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+        cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        if ((features_ & IORING_FEAT_SINGLE_MMAP) != 0) {
+            if (cq_ring_size_ > sq_ring_size_)
+                sq_ring_size_ = cq_ring_size_;
+            cq_ring_size_ = sq_ring_size_;
+        }
+
+        sq_ring_ptr_ = ::mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+        if (sq_ring_ptr_ == MAP_FAILED)
+            return -errno;
+
+        if ((features_ & IORING_FEAT_SINGLE_MMAP) != 0) {
+            cq_ring_ptr_ = sq_ring_ptr_;
+        }
+        else {
+            cq_ring_ptr_ = ::mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE,
+                                  MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_CQ_RING);
+            if (cq_ring_ptr_ == MAP_FAILED)
+                return -errno;
+        }
+
+        sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+        void * sqes = ::mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED)
+            return -errno;
+        sqes_ = (struct io_uring_sqe *)sqes;
+
+        char * sq_ring = (char *)sq_ring_ptr_;
+        sq_head_ = (uint32_t *)(sq_ring + params.sq_off.head);
+        sq_tail_ = (uint32_t *)(sq_ring + params.sq_off.tail);
+        sq_mask_ = *(uint32_t *)(sq_ring + params.sq_off.ring_mask);
+        sq_entries_ = *(uint32_t *)(sq_ring + params.sq_off.ring_entries);
+        sq_tail_local_ = *sq_tail_;
+        sq_submitted_ = sq_tail_local_;
+
+        // The SQ array maps the SQ ring entries to the SQEs one by one.
+        uint32_t * sq_array = (uint32_t *)(sq_ring + params.sq_off.array);
+        for (uint32_t i = 0; i < sq_entries_; ++i) {
+            sq_array[i] = i;
+        }
+
+        char * cq_ring = (char *)cq_ring_ptr_;
+        cq_head_ = (uint32_t *)(cq_ring + params.cq_off.head);
+        cq_tail_ = (uint32_t *)(cq_ring + params.cq_off.tail);
+        cq_mask_ = *(uint32_t *)(cq_ring + params.cq_off.ring_mask);
+        cqes_ = (struct io_uring_cqe *)(cq_ring + params.cq_off.cqes);
+        return 0;
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// A provided buffer ring: the kernel picks a free buffer for every completion of a
+// multishot recv, so the idle connections hold no receive buffer at all. A buffer
+// returns to the ring by recycle(), commit() publishes the recycled buffers to the kernel.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+class io_uring_buffer_ring : private boost::noncopyable {
+private:
+    // The ring is used as an array of io_uring_buf, the tail overlays the resv of the first
+    // entry. io_uring_buf_ring::bufs can't be used in C++, its __DECLARE_FLEX_ARRAY() puts an
+    // empty struct (of 1 byte in C++) before the array, so it's at offset 8 instead of 0.
+    struct io_uring_buf * buf_ring_;
+    char *      buffers_;
+    std::size_t buf_ring_size_;
+    std::size_t buffers_size_;
+    uint32_t    entries_;
+    uint32_t    mask_;
+    uint32_t    buffer_size_;
+    uint16_t    bgid_;
+    uint16_t    tail_;
+    uint32_t    recycled_;
+
+public:
+    io_uring_buffer_ring()
+        : buf_ring_(nullptr), buffers_(nullptr), buf_ring_size_(0), buffers_size_(0),
+          entries_(0), mask_(0), buffer_size_(0), bgid_(0), tail_(0), recycled_(0)
+    {
+    }
+
+    ~io_uring_buffer_ring()
+    {
+        if (buffers_ != nullptr)
+            ::munmap(buffers_, buffers_size_);
+        if (buf_ring_ != nullptr)
+            ::munmap(buf_ring_, buf_ring_size_);
+    }
+
+    uint16_t bgid() const { return bgid_; }
+    uint32_t buffer_size() const { return buffer_size_; }
+
+    /// entries must be a power of 2.
+    int init(io_uring_ring & ring, uint16_t bgid, uint32_t entries, uint32_t buffer_size)
+    {
+        bgid_ = bgid;
+        entries_ = entries;
+        mask_ = entries - 1;
+        buffer_size_ = buffer_size;
+
+        buf_ring_size_ = entries * sizeof(struct io_uring_buf);
+        void * buf_ring = ::mmap(nullptr, buf_ring_size_, PROT_READ | PROT_WRITE,
+                                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buf_ring == MAP_FAILED)
+            return -errno;
+        buf_ring_ = (struct io_uring_buf *)buf_ring;
+
+        buffers_size_ = (std::size_t)entries * buffer_size;
+        void * buffers = ::mmap(nullptr, buffers_size_, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (buffers == MAP_FAILED)
+            return -errno;
+        buffers_ = (char *)buffers;
+
+        int ret = ring.register_buffer_ring(buf_ring, entries, bgid);
+        if (ret < 0)
+            return ret;
+
+        for (uint32_t i = 0; i < entries; ++i) {
+            recycle((uint16_t)i);
+        }
+        commit();
+        return 0;
+    }
+
+    char * buffer(uint16_t bid) const
+    {
+        return (buffers_ + (std::size_t)bid * buffer_size_);
+    }
+
+    void recycle(uint16_t bid)
+    {
+        struct io_uring_buf * buf = &buf_ring_[tail_ & mask_];
+        buf->addr = (uint64_t)(uintptr_t)buffer(bid);
+        buf->len = buffer_size_;
+        buf->bid = bid;
+        tail_++;
+        recycled_++;
+    }
+
+    /// Publish the recycled buffers, return how many of them.
+    uint32_t commit()
+    {
+        uint32_t recycled = recycled_;
+        if (recycled > 0) {
+            __atomic_store_n(&buf_ring_[0].resv, tail_, __ATOMIC_RELEASE);
+            recycled_ = 0;
+        }
+        return recycled;
+    }
+};
+
+//
+// The kernel may have io_uring disabled (the kernel.io_uring_disabled sysctl or seccomp),
+// or be older than the engine needs: the sparse file table and the provided buffer rings
+// are registered by every worker (Linux 5.19), and the multishot recv needs Linux 6.0,
+// it has no probe of its own, IORING_OP_SEND_ZC of the same release stands for it.
+// Without them every worker would fail after the server has started, so they are
+// tried on a small ring here, before the engine is chosen.
+//
+inline bool io_uring_ring::is_supported()
+{
+    io_uring_ring ring;
+    if (ring.init(4, 8) < 0)
+        return false;
+
+    static const uint8_t kOpcodes[] = {
+        IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SENDMSG, IORING_OP_SHUTDOWN,
+        IORING_OP_CLOSE, IORING_OP_POLL_ADD, IORING_OP_ASYNC_CANCEL, IORING_OP_SEND_ZC
+    };
+    for (std::size_t i = 0; i < sizeof(kOpcodes) / sizeof(kOpcodes[0]); ++i) {
+        if (!ring.is_op_supported(kOpcodes[i]))
+            return false;
+    }
+
+    if (ring.register_files_sparse(1) < 0)
+        return false;
+
+    io_uring_buffer_ring buffers;
+    return (buffers.init(ring, 0, 1, 64) == 0);
+}
+
+} // namespace asio_test
+
+#endif // HAS_IO_URING
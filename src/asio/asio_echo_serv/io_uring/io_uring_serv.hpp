@@ -0,0 +1,896 @@
+#pragma once
+
+#include "io_uring_ring.hpp"
+
+#if HAS_IO_URING
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <boost/noncopyable.hpp>
+
+#include "../common.h"
+#include "../cpu_affinity.hpp"
+#include "../http_server/http_scanner.hpp"
+#include "../http_server/http_response.hpp"
+#include "common/process_stats.hpp"
+
+namespace asio_test {
+
+//
+// The state of a connection of the io_uring engine, it's indexed by its slot in the
+// fixed file table, and reused by the next connection accepted into the same slot.
+//
+class io_uring_connection : private boost::noncopyable {
+public:
+    // A connection holds at most kMaxEchoBuffers provided buffers, so a peer which doesn't
+    // read its echoes can't take the buffers of the other connections of the worker.
+    enum { kMaxSendBuffers = 16, kMaxEchoBuffers = 64 };
+
+    // A received buffer waiting to be echoed, it's still owned by the connection.
+    struct echo_buffer {
+        uint16_t bid;
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    uint32_t    file_index;
+    bool        recving;
+    bool        sending;
+    bool        closing;
+    bool        releasing;
+    bool        recv_stalled;
+    bool        recv_parked;
+    uint32_t    recv_bytes_remain;
+    uint32_t    send_bytes_remain;
+
+    // The echo queue, the first send_buffer_count buffers are being sent.
+    std::deque<echo_buffer> echo_buffers;
+    uint32_t    send_buffer_count;
+
+    // The http requests which are not complete yet (they have been scanned), the queued
+    // responses, and the responses being sent.
+    std::string http_requests;
+    std::string http_responses;
+    std::string http_sending;
+    std::vector<uint32_t> request_boundaries;
+
+    struct iovec    iovecs[kMaxSendBuffers];
+    struct msghdr   msg;
+
+    io_uring_connection()
+    {
+        reset(0);
+    }
+
+    void reset(uint32_t index)
+    {
+        file_index = index;
+        recving = false;
+        sending = false;
+        closing = false;
+        releasing = false;
+        recv_stalled = false;
+        recv_parked = false;
+        recv_bytes_remain = 0;
+        send_bytes_remain = 0;
+        echo_buffers.clear();
+        send_buffer_count = 0;
+        http_requests.clear();
+        http_responses.clear();
+        http_sending.clear();
+        request_boundaries.clear();
+        ::memset(&msg, 0, sizeof(msg));
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// One thread and one ring of the io_uring engine:
+//
+//   - A multishot accept installs the new sockets into the fixed file table directly,
+//     the connections never have a normal file descriptor.
+//   - A multishot recv per connection picks the buffers from the provided buffer ring,
+//     the echo sends the same buffers back and recycles them after the send.
+//   - All of the SQEs queued by a batch of completions are submitted by the same
+//     io_uring_enter() which waits for the next completions.
+//
+// When the buffer ring runs out, the multishot recv ends with ENOBUFS, the connection
+// stops reading (the TCP window closes) until the sends recycle some buffers. A connection
+// holding kMaxEchoBuffers unsent echoes is parked the same way: its recv is cancelled and
+// armed again when the sends have recycled half of them.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+class io_uring_worker : private boost::noncopyable {
+public:
+    enum {
+        kQueueDepth = 4096,
+        kBufferCount = 1024,
+        kBufferSize = 16384,
+        kBufferGroup = 0,
+        kMaxFiles = 65536,
+        kMaxRequestSize = 65536
+    };
+
+    enum serv_mode_t {
+        serv_mode_echo,
+        serv_mode_sink,
+        serv_mode_http
+    };
+
+private:
+    enum op_type_t {
+        op_accept = 1,
+        op_recv,
+        op_send,
+        op_shutdown,
+        op_close,
+        op_cancel,
+        op_wakeup
+    };
+
+    io_uring_ring           ring_;
+    io_uring_buffer_ring    buffers_;
+    std::size_t             index_;
+    int                     listen_fd_;
+    int                     wakeup_fd_;
+    uint32_t                serv_mode_;
+    uint32_t                packet_size_;
+    uint32_t                max_files_;
+    uint32_t                spin_us_;
+    bool                    accept_stalled_;
+    const http_response_table * responses_;
+
+    std::vector< std::unique_ptr<io_uring_connection> > connections_;
+    std::vector<uint32_t>   stalled_recvs_;
+
+    std::atomic<bool>       stopped_;
+    std::atomic<bool>       failed_;
+    std::atomic<int>        thread_id_;
+    std::atomic<uint64_t>   enter_count_;
+    std::atomic<uint64_t>   cqe_count_;
+
+public:
+    io_uring_worker(std::size_t index, int listen_fd, uint32_t serv_mode, uint32_t packet_size,
+                    uint32_t spin_us, const http_response_table * responses)
+        : index_(index), listen_fd_(listen_fd), wakeup_fd_(-1), serv_mode_(serv_mode),
+          packet_size_(packet_size), max_files_(0), spin_us_(spin_us), accept_stalled_(false), responses_(responses),
+          stopped_(false), failed_(false), thread_id_(0), enter_count_(0), cqe_count_(0)
+    {
+        // The eventfd wakes up the worker to stop, it's created here so stop() can't race with run().
+        wakeup_fd_ = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    }
+
+    ~io_uring_worker()
+    {
+        if (wakeup_fd_ >= 0)
+            ::close(wakeup_fd_);
+    }
+
+    /// Whether the worker has stopped by an error of its ring.
+    bool failed() const { return failed_.load(); }
+    int thread_id() const { return thread_id_.load(std::memory_order_relaxed); }
+    uint64_t enter_count() const { return enter_count_.load(std::memory_order_relaxed); }
+    uint64_t cqe_count() const { return cqe_count_.load(std::memory_order_relaxed); }
+
+    /// The thread function, the ring must be created by the thread which submits to it.
+    void run()
+    {
+        thread_id_.store(process_stats::current_thread_id(), std::memory_order_relaxed);
+
+        int ret = init();
+        if (ret < 0) {
+            std::cout << "io_uring_worker::run() - Error: (code = " << -ret << ") "
+                      << ::strerror(-ret) << std::endl;
+            failed_.store(true);
+            return;
+        }
+
+        post_wakeup();
+        post_accept();
+
+        // Spin-then-park: reap the completions without waiting until none has come for
+        // spin_us_ microseconds, then block in io_uring_enter() for the next one.
+        typedef std::chrono::steady_clock clock_type;
+        const clock_type::duration spin_time = std::chrono::microseconds(spin_us_);
+        clock_type::time_point idle_since = clock_type::now();
+        bool spinning = false;
+
+        while (!stopped_.load(std::memory_order_relaxed)) {
+            ret = ring_.submit(spinning ? 0 : 1);
+            if (ret < 0 && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY) {
+                std::cout << "io_uring_worker::run() - Error: (code = " << -ret << ") "
+                          << ::strerror(-ret) << std::endl;
+                failed_.store(true);
+                break;
+            }
+
+            uint32_t cqe_count = ring_.for_each_cqe([this](const struct io_uring_cqe & cqe) {
+                handle_cqe(cqe);
+            });
+
+            // Publish the recycled buffers once per batch, and restart the recvs starved of them.
+            if (buffers_.commit() > 0 && !stalled_recvs_.empty())
+                resume_stalled_recvs();
+
+            enter_count_.store(ring_.enter_count(), std::memory_order_relaxed);
+            cqe_count_.store(cqe_count_.load(std::memory_order_relaxed) + cqe_count, std::memory_order_relaxed);
+
+            if (spin_us_ > 0) {
+                clock_type::time_point now = clock_type::now();
+                if (cqe_count > 0)
+                    idle_since = now;
+                spinning = ((now - idle_since) < spin_time);
+            }
+        }
+    }
+
+    void stop()
+    {
+        stopped_.store(true);
+        if (wakeup_fd_ >= 0) {
+            eventfd_t value = 1;
+            ::eventfd_write(wakeup_fd_, value);
+        }
+    }
+
+private:
+    int init()
+    {
+        if (wakeup_fd_ < 0)
+            return -EBADF;
+
+        int ret = ring_.init(kQueueDepth, kQueueDepth * 4);
+        if (ret < 0)
+            return ret;
+
+        // The registered file table can't be larger than RLIMIT_NOFILE.
+        max_files_ = kMaxFiles;
+        struct rlimit limit;
+        if (::getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < max_files_)
+            max_files_ = (uint32_t)limit.rlim_cur;
+        ret = ring_.register_files_sparse(max_files_);
+        if (ret < 0)
+            return ret;
+        connections_.resize(max_files_);
+
+        return buffers_.init(ring_, kBufferGroup, kBufferCount, kBufferSize);
+    }
+
+    static uint64_t make_user_data(uint32_t op, uint32_t file_index)
+    {
+        return (((uint64_t)op << 32) | file_index);
+    }
+
+    struct io_uring_sqe * get_sqe()
+    {
+        struct io_uring_sqe * sqe = ring_.get_sqe();
+        if (sqe == nullptr) {
+            std::cout << "io_uring_worker::get_sqe() - Error: the submission queue is full." << std::endl;
+        }
+        return sqe;
+    }
+
+    void post_accept()
+    {
+        struct io_uring_sqe * sqe = get_sqe();
+        if (sqe != nullptr)
+            io_uring_ring::prep_multishot_accept_direct(sqe, listen_fd_, make_user_data(op_accept, 0));
+    }
+
+    void post_wakeup()
+    {
+        struct io_uring_sqe * sqe = get_sqe();
+        if (sqe != nullptr)
+            io_uring_ring::prep_multishot_poll(sqe, wakeup_fd_, POLLIN, make_user_data(op_wakeup, 0));
+    }
+
+    void post_recv(io_uring_connection * conn)
+    {
+        struct io_uring_sqe * sqe = get_sqe();
+        if (sqe != nullptr) {
+            io_uring_ring::prep_multishot_recv(sqe, conn->file_index, buffers_.bgid(),
+                                               make_user_data(op_recv, conn->file_index));
+            conn->recving = true;
+        }
+    }
+
+    void post_send(io_uring_connection * conn, uint32_t iovec_count)
+    {
+        struct io_uring_sqe * sqe = get_sqe();
+        if (sqe != nullptr) {
+            conn->msg.msg_iov = conn->iovecs;
+            conn->msg.msg_iovlen = iovec_count;
+            io_uring_ring::prep_sendmsg(sqe, conn->file_index, &conn->msg,
+                                        make_user_data(op_send, conn->file_index));
+            conn->sending = true;
+        }
+    }
+
+    void handle_cqe(const struct io_uring_cqe & cqe)
+    {
+        uint32_t op = (uint32_t)(cqe.user_data >> 32);
+        uint32_t file_index = (uint32_t)cqe.user_data;
+        switch (op) {
+        case op_accept:
+            handle_accept(cqe);
+            break;
+        case op_recv:
+            handle_recv(connections_[file_index].get(), cqe);
+            break;
+        case op_send:
+            handle_send(connections_[file_index].get(), cqe);
+            break;
+        case op_close:
+            handle_close(connections_[file_index].get());
+            break;
+        case op_wakeup:
+            // Wake up to check the stop flag.
+            if ((cqe.flags & IORING_CQE_F_MORE) == 0 && !stopped_.load(std::memory_order_relaxed))
+                post_wakeup();
+            break;
+        default:
+            // op_shutdown and op_cancel, the recv completes after them.
+            break;
+        }
+    }
+
+    void handle_accept(const struct io_uring_cqe & cqe)
+    {
+        if (cqe.res >= 0) {
+            uint32_t file_index = (uint32_t)cqe.res;
+            std::unique_ptr<io_uring_connection> & conn = connections_[file_index];
+            if (!conn)
+                conn.reset(new io_uring_connection());
+            conn->reset(file_index);
+            g_client_count++;
+            post_recv(conn.get());
+        }
+        else if (cqe.res == -ENFILE) {
+            // The fixed file table is full, accept again after a connection is closed.
+            accept_stalled_ = true;
+        }
+        else {
+            // Accept error
+            std::cout << "io_uring_worker::handle_accept() - Error: (code = " << -cqe.res << ") "
+                      << ::strerror(-cqe.res) << std::endl;
+            // The listener or the request is bad, arming it again would fail forever.
+            if (cqe.res == -EINVAL || cqe.res == -EBADF || cqe.res == -ENOTSOCK)
+                return;
+        }
+
+        // The multishot accept is terminated by an error, arm it again.
+        if ((cqe.flags & IORING_CQE_F_MORE) == 0 && !accept_stalled_)
+            post_accept();
+    }
+
+    void handle_recv(io_uring_connection * conn, const struct io_uring_cqe & cqe)
+    {
+        bool more = ((cqe.flags & IORING_CQE_F_MORE) != 0);
+        if (!more)
+            conn->recving = false;
+
+        if (cqe.res > 0) {
+            uint16_t bid = (uint16_t)(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            uint32_t recv_bytes = (uint32_t)cqe.res;
+            if (!conn->closing) {
+                // Count the recieved bytes
+                g_recv_bytes.add(recv_bytes);
+                handle_data(conn, bid, recv_bytes);
+            }
+            else {
+                buffers_.recycle(bid);
+            }
+
+            // The kernel may end a multishot recv at any time, arm it again.
+            if (!conn->recving && !conn->closing && !conn->recv_parked)
+                post_recv(conn);
+        }
+        else if (conn->recv_parked && !conn->closing
+                 && (cqe.res == -ECANCELED || cqe.res == -ENOBUFS)) {
+            // Parked, the sends arm it again.
+        }
+        else if (cqe.res == -ECANCELED && !conn->closing) {
+            // Cancelled by a park which has been resumed before the recv completed.
+            if (!conn->recving)
+                post_recv(conn);
+        }
+        else if (cqe.res == -ENOBUFS && !conn->closing) {
+            // Out of the provided buffers, wait for the sends to recycle some.
+            conn->recv_stalled = true;
+            stalled_recvs_.push_back(conn->file_index);
+        }
+        else {
+            if (cqe.res < 0 && cqe.res != -ECONNRESET && !conn->closing) {
+                // Write error log
+                std::cout << "io_uring_worker::handle_recv() - Error: (code = " << -cqe.res << ") "
+                          << ::strerror(-cqe.res) << std::endl;
+            }
+            close_connection(conn);
+        }
+
+        if (!conn->recving && conn->closing)
+            try_release(conn);
+    }
+
+    void handle_data(io_uring_connection * conn, uint16_t bid, uint32_t recv_bytes)
+    {
+        if (serv_mode_ == serv_mode_echo) {
+            io_uring_connection::echo_buffer buffer;
+            buffer.bid = bid;
+            buffer.offset = 0;
+            buffer.length = recv_bytes;
+            conn->echo_buffers.push_back(buffer);
+            do_echo_send(conn);
+            if (conn->echo_buffers.size() >= io_uring_connection::kMaxEchoBuffers)
+                park_recv(conn);
+        }
+        else if (serv_mode_ == serv_mode_http) {
+            bool succeed = handle_http_requests(conn, buffers_.buffer(bid), recv_bytes);
+            buffers_.recycle(bid);
+            if (succeed) {
+                do_http_send(conn);
+            }
+            else {
+                std::cout << "io_uring_worker::handle_data() - Error: the http request is more than "
+                          << kMaxRequestSize << " bytes." << std::endl;
+                close_connection(conn);
+            }
+        }
+        else {
+            // Counter the recieved qps
+            uint32_t delta_bytes = conn->recv_bytes_remain + recv_bytes;
+            uint32_t delta_query_count = delta_bytes / packet_size_;
+            if (delta_query_count > 0)
+                g_query_count.add(delta_query_count);
+            conn->recv_bytes_remain = delta_bytes - packet_size_ * delta_query_count;
+            buffers_.recycle(bid);
+        }
+    }
+
+    /// The echoed buffers are sent in order by one gather send at a time.
+    void do_echo_send(io_uring_connection * conn)
+    {
+        if (conn->sending || conn->closing || conn->echo_buffers.empty())
+            return;
+
+        uint32_t count = 0;
+        for (std::deque<io_uring_connection::echo_buffer>::const_iterator it = conn->echo_buffers.begin();
+             it != conn->echo_buffers.end() && count < io_uring_connection::kMaxSendBuffers; ++it) {
+            conn->iovecs[count].iov_base = buffers_.buffer(it->bid) + it->offset;
+            conn->iovecs[count].iov_len = it->length;
+            count++;
+        }
+        conn->send_buffer_count = count;
+        post_send(conn, count);
+    }
+
+    void do_http_send(io_uring_connection * conn)
+    {
+        if (conn->sending || conn->closing)
+            return;
+
+        if (conn->http_sending.empty())
+            conn->http_sending.swap(conn->http_responses);
+        if (conn->http_sending.empty())
+            return;
+
+        conn->iovecs[0].iov_base = &conn->http_sending[0];
+        conn->iovecs[0].iov_len = conn->http_sending.size();
+        post_send(conn, 1);
+    }
+
+    void handle_send(io_uring_connection * conn, const struct io_uring_cqe & cqe)
+    {
+        conn->sending = false;
+        if (cqe.res < 0 || conn->closing) {
+            if (cqe.res < 0 && cqe.res != -EPIPE && cqe.res != -ECONNRESET && !conn->closing) {
+                // Write error log
+                std::cout << "io_uring_worker::handle_send() - Error: (code = " << -cqe.res << ") "
+                          << ::strerror(-cqe.res) << std::endl;
+            }
+            close_connection(conn);
+            return;
+        }
+
+        uint32_t send_bytes = (uint32_t)cqe.res;
+        g_send_bytes.add(send_bytes);
+
+        if (serv_mode_ == serv_mode_http) {
+            // A short send keeps the rest to send again.
+            conn->http_sending.erase(0, send_bytes);
+            do_http_send(conn);
+        }
+        else {
+            // If get a circle of ping-pong, we count the query one time.
+            uint32_t delta_bytes = conn->send_bytes_remain + send_bytes;
+            uint32_t delta_query_count = delta_bytes / packet_size_;
+            if (delta_query_count > 0)
+                g_query_count.add(delta_query_count);
+            conn->send_bytes_remain = delta_bytes - packet_size_ * delta_query_count;
+
+            // Recycle the buffers which were sent completely.
+            while (send_bytes > 0 && !conn->echo_buffers.empty()) {
+                io_uring_connection::echo_buffer & buffer = conn->echo_buffers.front();
+                if (send_bytes < buffer.length) {
+                    buffer.offset += send_bytes;
+                    buffer.length -= send_bytes;
+                    break;
+                }
+                send_bytes -= buffer.length;
+                buffers_.recycle(buffer.bid);
+                conn->echo_buffers.pop_front();
+            }
+            do_echo_send(conn);
+            if (conn->recv_parked && conn->echo_buffers.size() <= io_uring_connection::kMaxEchoBuffers / 2)
+                resume_recv(conn);
+        }
+    }
+
+    /// Stop the recv of a connection which holds too many echo buffers.
+    void park_recv(io_uring_connection * conn)
+    {
+        if (conn->recv_parked || conn->closing)
+            return;
+        conn->recv_parked = true;
+        if (conn->recving) {
+            struct io_uring_sqe * sqe = get_sqe();
+            if (sqe != nullptr)
+                io_uring_ring::prep_cancel(sqe, make_user_data(op_recv, conn->file_index),
+                                           make_user_data(op_cancel, conn->file_index));
+        }
+    }
+
+    void resume_recv(io_uring_connection * conn)
+    {
+        conn->recv_parked = false;
+        conn->recv_stalled = false;
+        // If the cancelled recv hasn't completed yet, it's armed again when it does.
+        if (!conn->recving && !conn->closing)
+            post_recv(conn);
+    }
+
+    bool handle_http_requests(io_uring_connection * conn, const char * data, uint32_t size)
+    {
+        // Scan the recieved buffer directly, unless there is an incomplete request before it.
+        const char * requests = data;
+        std::size_t length = size;
+        std::size_t scan_pos = 0;
+        if (!conn->http_requests.empty()) {
+            scan_pos = conn->http_requests.size();
+            conn->http_requests.append(data, size);
+            requests = conn->http_requests.data();
+            length = conn->http_requests.size();
+        }
+
+        conn->request_boundaries.clear();
+        http_scanner::scan(requests, scan_pos, length, conn->request_boundaries);
+
+        uint32_t request_count = (uint32_t)conn->request_boundaries.size();
+        uint32_t parsed = 0;
+        if (request_count > 0) {
+            // One response for every pipelined request: the prebuilt head, the Date line and the body.
+            const char * date_line = http_date_cache::get();
+            for (uint32_t i = 0; i < request_count; ++i) {
+                uint32_t request_end = conn->request_boundaries[i];
+                const http_route & route = responses_->match(requests + parsed, request_end - parsed);
+                conn->http_responses.append(route.head);
+                conn->http_responses.append(date_line, http_date_cache::kDateLineSize);
+                conn->http_responses.append(route.body);
+                parsed = request_end;
+            }
+            g_query_count.add(request_count);
+        }
+
+        if (conn->http_requests.empty())
+            conn->http_requests.assign(requests + parsed, length - parsed);
+        else
+            conn->http_requests.erase(0, parsed);
+        return (conn->http_requests.size() < kMaxRequestSize);
+    }
+
+    /// Shut down the socket to end the recv, the connection is released by the last completed operation.
+    void close_connection(io_uring_connection * conn)
+    {
+        if (!conn->closing) {
+            conn->closing = true;
+            if (conn->recving) {
+                struct io_uring_sqe * sqe = get_sqe();
+                if (sqe != nullptr)
+                    io_uring_ring::prep_shutdown(sqe, conn->file_index, make_user_data(op_shutdown, conn->file_index));
+            }
+        }
+        try_release(conn);
+    }
+
+    void try_release(io_uring_connection * conn)
+    {
+        if (conn->recving || conn->sending || conn->releasing)
+            return;
+
+        for (std::size_t i = 0; i < conn->echo_buffers.size(); ++i) {
+            buffers_.recycle(conn->echo_buffers[i].bid);
+        }
+        conn->echo_buffers.clear();
+
+        // The closing flag is kept until the close completes, so nothing is posted after it.
+        struct io_uring_sqe * sqe = get_sqe();
+        if (sqe != nullptr) {
+            io_uring_ring::prep_close_direct(sqe, conn->file_index, make_user_data(op_close, conn->file_index));
+            conn->releasing = true;
+        }
+    }
+
+    void handle_close(io_uring_connection * conn)
+    {
+        conn->reset(conn->file_index);
+        g_client_count--;
+
+        if (accept_stalled_) {
+            accept_stalled_ = false;
+            post_accept();
+        }
+    }
+
+    void resume_stalled_recvs()
+    {
+        for (std::size_t i = 0; i < stalled_recvs_.size(); ++i) {
+            io_uring_connection * conn = connections_[stalled_recvs_[i]].get();
+            // The slot may have been closed or reused since it stalled.
+            if (conn->recv_stalled && !conn->recving && !conn->closing) {
+                conn->recv_stalled = false;
+                // A parked recv is armed again by the sends.
+                if (!conn->recv_parked)
+                    post_recv(conn);
+            }
+        }
+        stalled_recvs_.clear();
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////////
+//
+// The io_uring engine of the echo, no-echo and http servers (--engine=io_uring),
+// one io_uring_worker per thread. If SO_REUSEPORT is enabled, every worker owns
+// its listener, otherwise all of the workers accept from the same listener.
+//
+////////////////////////////////////////////////////////////////////////////////////
+
+class io_uring_serv : private boost::noncopyable {
+private:
+    typedef std::unique_ptr<io_uring_worker>    worker_ptr;
+    typedef std::shared_ptr<std::thread>        thread_ptr;
+
+    std::vector<int>            listen_fds_;
+    std::vector<worker_ptr>     workers_;
+    std::vector<thread_ptr>     threads_;
+    http_response_table         responses_;
+    uint32_t                    serv_mode_;
+    uint32_t                    packet_size_;
+    uint32_t                    thread_num_;
+    bool                        reuse_port_;
+
+public:
+    io_uring_serv(uint32_t packet_size = 64,
+                  uint32_t thread_num = std::thread::hardware_concurrency())
+        : serv_mode_(get_serv_mode()), packet_size_(packet_size), thread_num_(thread_num),
+          reuse_port_(g_reuse_port != 0)
+    {
+        if (thread_num_ == 0)
+            thread_num_ = 1;
+        if (serv_mode_ == io_uring_worker::serv_mode_http)
+            create_response_table();
+    }
+
+    ~io_uring_serv()
+    {
+        stop();
+        join();
+        for (std::size_t i = 0; i < listen_fds_.size(); ++i) {
+            ::close(listen_fds_[i]);
+        }
+    }
+
+    static const char * get_serv_mode_name(uint32_t serv_mode)
+    {
+        switch (serv_mode) {
+        case io_uring_worker::serv_mode_echo:
+            return "echo";
+        case io_uring_worker::serv_mode_sink:
+            return "sink";
+        case io_uring_worker::serv_mode_http:
+            return "http";
+        default:
+            return "unknown";
+        }
+    }
+
+    uint32_t serv_mode() const { return serv_mode_; }
+
+    /// Listen and start the workers, return false if it can't listen on ip_addr:port.
+    bool start(const std::string & ip_addr, const std::string & port)
+    {
+        std::size_t listener_count = (reuse_port_) ? thread_num_ : 1;
+        for (std::size_t i = 0; i < listener_count; ++i) {
+            int listen_fd = create_listener(ip_addr, port);
+            if (listen_fd < 0)
+                return false;
+            listen_fds_.push_back(listen_fd);
+        }
+
+        for (uint32_t i = 0; i < thread_num_; ++i) {
+            workers_.push_back(worker_ptr(new io_uring_worker(i, listen_fds_[i % listen_fds_.size()],
+                                                              serv_mode_, packet_size_, g_busy_poll, &responses_)));
+        }
+        for (uint32_t i = 0; i < thread_num_; ++i) {
+            threads_.push_back(std::make_shared<std::thread>(&io_uring_serv::run_worker, this, i));
+        }
+        return true;
+    }
+
+    void stop()
+    {
+        for (std::size_t i = 0; i < workers_.size(); ++i) {
+            workers_[i]->stop();
+        }
+    }
+
+    void join()
+    {
+        for (std::size_t i = 0; i < threads_.size(); ++i) {
+            if (threads_[i]->joinable())
+                threads_[i]->join();
+        }
+    }
+
+    /// Whether any worker has stopped by an error, the server can't serve its connections.
+    bool failed() const
+    {
+        for (std::size_t i = 0; i < workers_.size(); ++i) {
+            if (workers_[i]->failed())
+                return true;
+        }
+        return false;
+    }
+
+    /// The io_uring_enter() calls of all of the workers.
+    uint64_t enter_count() const
+    {
+        uint64_t enter_count = 0;
+        for (std::size_t i = 0; i < workers_.size(); ++i) {
+            enter_count += workers_[i]->enter_count();
+        }
+        return enter_count;
+    }
+
+    /// The per worker statistics, for the stats endpoint (see server_stats_sampler), the
+    /// io_uring engine has no session pools, start queues or buffer pools of its own.
+    std::size_t io_service_count() const { return workers_.size(); }
+    int thread_id(std::size_t index) const { return workers_[index]->thread_id(); }
+    std::size_t start_queue_size(std::size_t /* index */) const { return 0; }
+    std::size_t free_sessions(std::size_t /* index */) const { return 0; }
+    std::size_t free_buffers(std::size_t /* index */) const { return 0; }
+    uint64_t session_pool_hits() const { return 0; }
+    uint64_t session_pool_misses() const { return 0; }
+    uint64_t buffer_pool_misses() const { return 0; }
+
+    /// The completions of all of the workers.
+    uint64_t cqe_count() const
+    {
+        uint64_t cqe_count = 0;
+        for (std::size_t i = 0; i < workers_.size(); ++i) {
+            cqe_count += workers_[i]->cqe_count();
+        }
+        return cqe_count;
+    }
+
+private:
+    static uint32_t get_serv_mode()
+    {
+        if (g_test_mode == test_mode_http_server)
+            return io_uring_worker::serv_mode_http;
+        else if (get_echo_session_mode() == mode_no_echo)
+            return io_uring_worker::serv_mode_sink;
+        else
+            return io_uring_worker::serv_mode_echo;
+    }
+
+    void create_response_table()
+    {
+        // The routes have been checked by the command line parser.
+        for (std::size_t i = 0; i < g_http_routes.size(); ++i) {
+            responses_.add_route(g_http_routes[i]);
+        }
+        if (responses_.size() == 0)
+            responses_.add_hello_world();
+    }
+
+    void run_worker(std::size_t index)
+    {
+        if (!g_cpu_list.empty()) {
+            // If there are more threads than cpus, wrap around the cpu list.
+            int cpu = g_cpu_list[index % g_cpu_list.size()];
+            if (!bind_thread_to_cpu(cpu)) {
+                std::cout << "io_uring_serv::run_worker() - Error: can not bind thread "
+                          << index << " to cpu " << cpu << "." << std::endl;
+            }
+            else if (g_numa_local != 0) {
+                int node = get_cpu_numa_node(cpu);
+                if (!bind_thread_memory_to_node(node)) {
+                    std::cout << "io_uring_serv::run_worker() - Error: can not bind thread "
+                              << index << " memory to NUMA node " << node << "." << std::endl;
+                }
+            }
+        }
+        workers_[index]->run();
+    }
+
+    int create_listener(const std::string & ip_addr, const std::string & port)
+    {
+        struct addrinfo hints;
+        ::memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+
+        struct addrinfo * result = nullptr;
+        int ret = ::getaddrinfo(ip_addr.c_str(), port.c_str(), &hints, &result);
+        if (ret != 0 || result == nullptr) {
+            std::cout << "io_uring_serv::create_listener() - Error: (code = " << ret << ") "
+                      << ::gai_strerror(ret) << std::endl;
+            return -1;
+        }
+
+        int error = 0;
+        int listen_fd = ::socket(result->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listen_fd < 0) {
+            error = errno;
+        }
+        else {
+            int enable = 1;
+            ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+            if (reuse_port_)
+                ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable));
+            // The accepted sockets inherit TCP_NODELAY from the listener, they have no
+            // normal file descriptor to set it later.
+            if (g_nodelay != 0)
+                ::setsockopt(listen_fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+            if (::bind(listen_fd, result->ai_addr, result->ai_addrlen) != 0
+                || ::listen(listen_fd, SOMAXCONN) != 0) {
+                error = errno;
+                ::close(listen_fd);
+                listen_fd = -1;
+            }
+        }
+        ::freeaddrinfo(result);
+
+        if (listen_fd < 0) {
+            std::cout << "io_uring_serv::create_listener() - Error: (code = " << error << ") "
+                      << ::strerror(error) << std::endl;
+        }
+        return listen_fd;
+    }
+};
+
+} // namespace asio_test
+
+#endif // HAS_IO_URING
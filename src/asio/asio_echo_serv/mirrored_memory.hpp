@@ -0,0 +1,107 @@
+#pragma once
+
+#include <stdint.h>
+#include <boost/noncopyable.hpp>
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+#if defined(__linux__) && defined(SYS_memfd_create)
+#define HAS_MIRRORED_MEMORY     1
+#else
+#define HAS_MIRRORED_MEMORY     0
+#endif
+
+namespace asio_test {
+
+//
+// A block of memory which is mapped twice, back to back, in the virtual address space:
+//
+//    data()                 data() + size()                data() + size() * 2
+//      |---------------------------|--------------------------------|
+//      |       physical pages      |   the same physical pages      |
+//
+// So any region of size() bytes starting in the first half is contiguous, a ring
+// buffer built on it needn't to split its reads and writes at the end, or to move
+// the data back to the bottom.
+//
+// Only Linux is supported (memfd_create + mmap), is_mirrored() is false on the
+// other platforms or when the mapping failed, the caller should fall back to a
+// normal buffer.
+//
+class mirrored_memory : private boost::noncopyable {
+private:
+    char *      data_;
+    std::size_t size_;
+
+public:
+    mirrored_memory() : data_(nullptr), size_(0) {}
+    ~mirrored_memory()
+    {
+        release();
+    }
+
+    char * data() const { return data_; }
+    std::size_t size() const { return size_; }
+    bool is_mirrored() const { return (data_ != nullptr); }
+
+    /// The size will be rounded up to the page size.
+    bool allocate(std::size_t size)
+    {
+        release();
+#if HAS_MIRRORED_MEMORY
+        std::size_t page_size = (std::size_t)::sysconf(_SC_PAGESIZE);
+        size = (size + page_size - 1) / page_size * page_size;
+        if (size == 0)
+            return false;
+
+        int fd = (int)::syscall(SYS_memfd_create, "mirrored_memory", (unsigned int)MFD_CLOEXEC);
+        if (fd < 0)
+            return false;
+        if (::ftruncate(fd, (off_t)size) != 0) {
+            ::close(fd);
+            return false;
+        }
+
+        // Reserve the whole address range first, then map the file twice into it.
+        void * reserved = ::mmap(nullptr, size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (reserved == MAP_FAILED) {
+            ::close(fd);
+            return false;
+        }
+        char * base = static_cast<char *>(reserved);
+        void * first  = ::mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+        void * second = ::mmap(base + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+        // The mappings hold their own reference to the file.
+        ::close(fd);
+        if (first != base || second != (base + size)) {
+            ::munmap(base, size * 2);
+            return false;
+        }
+
+        data_ = base;
+        size_ = size;
+        return true;
+#else
+        (void)size;
+        return false;
+#endif // HAS_MIRRORED_MEMORY
+    }
+
+    void release()
+    {
+#if HAS_MIRRORED_MEMORY
+        if (data_ != nullptr) {
+            ::munmap(data_, size_ * 2);
+        }
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+};
+
+} // namespace asio_test
@@ -0,0 +1,256 @@
+#pragma once
+
+#include <stdint.h>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include "common.h"
+#include "common/latency_histogram.hpp"
+#include "common/process_stats.hpp"
+
+namespace asio_test {
+
+//
+// A snapshot of the server statistics, sampled by the monitor loop once per interval.
+// The counters are the totals since the server started, the rates, the utilization and
+// the latency percentiles are of the last interval.
+//
+// It is written as plain text ("name value" lines, with the labels of the Prometheus
+// text format for the per thread values) or as JSON, see stats_server.
+//
+struct server_stats {
+    struct thread_t {
+        int         thread_id;
+        // The cpu time of the thread / the length of the interval, 1.0 is always busy.
+        // A spinning thread (busy-poll) is always busy.
+        double      utilization;
+        std::size_t start_queue;
+        std::size_t free_sessions;
+        std::size_t free_buffers;
+    };
+
+    std::string host;
+    std::string port;
+    std::string mode;
+    std::string protocol;
+    uint32_t    packet_size;
+
+    double      uptime;
+    double      interval;
+
+    uint64_t    query_count;
+    uint64_t    recv_bytes;
+    uint64_t    send_bytes;
+    uint64_t    accept_count;
+    uint32_t    connections;
+
+    double      qps;
+    double      recv_bytes_per_sec;
+    double      send_bytes_per_sec;
+    double      accepts_per_sec;
+
+    uint64_t    resident_memory;
+    uint64_t    pool_hits;
+    uint64_t    pool_misses;
+    uint64_t    buffer_allocs;
+    uint64_t    handler_heap_allocs;
+
+    std::vector<thread_t> threads;
+
+    // The heartbeat latency of the idle sessions (see g_heartbeat_latency), in nanoseconds.
+    latency_histogram heartbeat_latency;
+
+    server_stats()
+        : packet_size(0), uptime(0.0), interval(0.0),
+          query_count(0), recv_bytes(0), send_bytes(0), accept_count(0), connections(0),
+          qps(0.0), recv_bytes_per_sec(0.0), send_bytes_per_sec(0.0), accepts_per_sec(0.0),
+          resident_memory(0), pool_hits(0), pool_misses(0), buffer_allocs(0), handler_heap_allocs(0)
+    {
+    }
+
+    void write_text(std::ostream & os) const
+    {
+        os << std::setiosflags(std::ios::fixed) << std::setprecision(3);
+        os << "uptime_seconds " << uptime << "\n"
+           << "interval_seconds " << interval << "\n"
+           << "connections " << connections << "\n"
+           << "query_count " << query_count << "\n"
+           << "recv_bytes " << recv_bytes << "\n"
+           << "send_bytes " << send_bytes << "\n"
+           << "accept_count " << accept_count << "\n"
+           << "qps " << qps << "\n"
+           << "recv_bytes_per_sec " << recv_bytes_per_sec << "\n"
+           << "send_bytes_per_sec " << send_bytes_per_sec << "\n"
+           << "accepts_per_sec " << accepts_per_sec << "\n"
+           << "resident_memory_bytes " << resident_memory << "\n"
+           << "session_pool_hits " << pool_hits << "\n"
+           << "session_pool_misses " << pool_misses << "\n"
+           << "buffer_allocs " << buffer_allocs << "\n"
+           << "handler_heap_allocs " << handler_heap_allocs << "\n";
+        for (std::size_t i = 0; i < threads.size(); ++i) {
+            const thread_t & thread = threads[i];
+            os << "thread_utilization{thread=\"" << i << "\",tid=\"" << thread.thread_id << "\"} " << thread.utilization << "\n"
+               << "thread_start_queue{thread=\"" << i << "\"} " << thread.start_queue << "\n"
+               << "thread_free_sessions{thread=\"" << i << "\"} " << thread.free_sessions << "\n"
+               << "thread_free_buffers{thread=\"" << i << "\"} " << thread.free_buffers << "\n";
+        }
+        // The histogram values are in nanoseconds, write them in microseconds.
+        os << "heartbeat_latency_count " << heartbeat_latency.count() << "\n";
+        static const double kPercentiles[] = { 50.0, 90.0, 99.0, 99.9 };
+        for (std::size_t i = 0; i < sizeof(kPercentiles) / sizeof(kPercentiles[0]); ++i) {
+            os << "heartbeat_latency_us{quantile=\"" << std::setprecision(3) << (kPercentiles[i] / 100.0) << "\"} "
+               << (heartbeat_latency.value_at_percentile(kPercentiles[i]) / 1000.0) << "\n";
+        }
+        os << "heartbeat_latency_max_us " << (heartbeat_latency.max_value() / 1000.0) << "\n";
+        os << std::resetiosflags(std::ios::fixed);
+    }
+
+    void write_json(std::ostream & os) const
+    {
+        os << std::setiosflags(std::ios::fixed) << std::setprecision(3);
+        os << "{\n"
+           << "    \"host\": \"" << host.c_str() << "\",\n"
+           << "    \"port\": " << port.c_str() << ",\n"
+           << "    \"mode\": \"" << mode.c_str() << "\",\n"
+           << "    \"protocol\": \"" << protocol.c_str() << "\",\n"
+           << "    \"packet_size\": " << packet_size << ",\n"
+           << "    \"uptime_sec\": " << uptime << ",\n"
+           << "    \"interval_sec\": " << interval << ",\n"
+           << "    \"connections\": " << connections << ",\n"
+           << "    \"query_count\": " << query_count << ",\n"
+           << "    \"recv_bytes\": " << recv_bytes << ",\n"
+           << "    \"send_bytes\": " << send_bytes << ",\n"
+           << "    \"accept_count\": " << accept_count << ",\n"
+           << "    \"qps\": " << qps << ",\n"
+           << "    \"recv_bytes_per_sec\": " << recv_bytes_per_sec << ",\n"
+           << "    \"send_bytes_per_sec\": " << send_bytes_per_sec << ",\n"
+           << "    \"accepts_per_sec\": " << accepts_per_sec << ",\n"
+           << "    \"resident_memory\": " << resident_memory << ",\n"
+           << "    \"session_pool_hits\": " << pool_hits << ",\n"
+           << "    \"session_pool_misses\": " << pool_misses << ",\n"
+           << "    \"buffer_allocs\": " << buffer_allocs << ",\n"
+           << "    \"handler_heap_allocs\": " << handler_heap_allocs << ",\n"
+           << "    \"threads\": [";
+        for (std::size_t i = 0; i < threads.size(); ++i) {
+            const thread_t & thread = threads[i];
+            os << ((i == 0) ? "\n" : ",\n")
+               << "        { \"thread\": " << i << ", \"tid\": " << thread.thread_id
+               << ", \"utilization\": " << thread.utilization
+               << ", \"start_queue\": " << thread.start_queue
+               << ", \"free_sessions\": " << thread.free_sessions
+               << ", \"free_buffers\": " << thread.free_buffers << " }";
+        }
+        os << "\n    ],\n"
+           << "    \"heartbeat_latency_us\": {\n"
+           << "        \"count\": " << heartbeat_latency.count() << ",\n"
+           << "        \"mean\": " << (heartbeat_latency.mean() / 1000.0) << ",\n"
+           << "        \"p50\": " << (heartbeat_latency.value_at_percentile(50.0) / 1000.0) << ",\n"
+           << "        \"p90\": " << (heartbeat_latency.value_at_percentile(90.0) / 1000.0) << ",\n"
+           << "        \"p99\": " << (heartbeat_latency.value_at_percentile(99.0) / 1000.0) << ",\n"
+           << "        \"p99.9\": " << (heartbeat_latency.value_at_percentile(99.9) / 1000.0) << ",\n"
+           << "        \"max\": " << (heartbeat_latency.max_value() / 1000.0) << "\n"
+           << "    }\n"
+           << "}\n";
+        os << std::resetiosflags(std::ios::fixed);
+    }
+
+    std::string to_text() const
+    {
+        std::ostringstream oss;
+        write_text(oss);
+        return oss.str();
+    }
+
+    std::string to_json() const
+    {
+        std::ostringstream oss;
+        write_json(oss);
+        return oss.str();
+    }
+};
+
+//
+// Samples the server_stats of a server once per call, from the global counters and the
+// per io_service statistics of the server (async_asio_echo_serv_ex or async_asio_http_server).
+//
+template <typename Server>
+class server_stats_sampler {
+public:
+    typedef std::chrono::steady_clock   clock_type;
+
+private:
+    Server &                server_;
+    server_stats            stats_;
+    clock_type::time_point  start_time_;
+    clock_type::time_point  last_time_;
+    std::vector<uint64_t>   last_cpu_times_;
+
+public:
+    server_stats_sampler(Server & server, const std::string & host, const std::string & port,
+                         uint32_t packet_size)
+        : server_(server), start_time_(clock_type::now()), last_time_(start_time_),
+          last_cpu_times_(server.io_service_count(), 0)
+    {
+        stats_.host         = host;
+        stats_.port         = port;
+        stats_.mode         = g_test_mode_str;
+        stats_.protocol     = g_protocol_str;
+        stats_.packet_size  = packet_size;
+        stats_.threads.resize(server.io_service_count());
+    }
+
+    const server_stats & stats() const { return stats_; }
+
+    const server_stats & sample()
+    {
+        clock_type::time_point now = clock_type::now();
+        double interval = std::chrono::duration_cast< std::chrono::duration<double> >(now - last_time_).count();
+        if (interval <= 0.0)
+            interval = 1.0;
+        last_time_ = now;
+
+        uint64_t query_count  = (uint64_t)g_query_count;
+        uint64_t recv_bytes   = (uint64_t)g_recv_bytes;
+        uint64_t send_bytes   = (uint64_t)g_send_bytes;
+        uint64_t accept_count = (uint64_t)g_accept_count;
+
+        stats_.uptime = std::chrono::duration_cast< std::chrono::duration<double> >(now - start_time_).count();
+        stats_.interval = interval;
+        stats_.qps                = (query_count - stats_.query_count) / interval;
+        stats_.recv_bytes_per_sec = (recv_bytes - stats_.recv_bytes) / interval;
+        stats_.send_bytes_per_sec = (send_bytes - stats_.send_bytes) / interval;
+        stats_.accepts_per_sec    = (accept_count - stats_.accept_count) / interval;
+        stats_.query_count  = query_count;
+        stats_.recv_bytes   = recv_bytes;
+        stats_.send_bytes   = send_bytes;
+        stats_.accept_count = accept_count;
+        stats_.connections  = (uint32_t)g_client_count;
+
+        stats_.resident_memory      = process_stats::resident_memory();
+        stats_.pool_hits            = server_.session_pool_hits();
+        stats_.pool_misses          = server_.session_pool_misses();
+        stats_.buffer_allocs        = server_.buffer_pool_misses();
+        stats_.handler_heap_allocs  = (uint64_t)g_handler_heap_allocs;
+
+        for (std::size_t i = 0; i < stats_.threads.size(); ++i) {
+            server_stats::thread_t & thread = stats_.threads[i];
+            thread.thread_id = server_.thread_id(i);
+            uint64_t cpu_time = process_stats::thread_cpu_time(thread.thread_id);
+            thread.utilization = (cpu_time >= last_cpu_times_[i] && last_cpu_times_[i] != 0)
+                               ? ((cpu_time - last_cpu_times_[i]) / (interval * 1E9)) : 0.0;
+            last_cpu_times_[i] = cpu_time;
+            thread.start_queue   = server_.start_queue_size(i);
+            thread.free_sessions = server_.free_sessions(i);
+            thread.free_buffers  = server_.free_buffers(i);
+        }
+
+        g_heartbeat_latency.collect(stats_.heartbeat_latency);
+        return stats_;
+    }
+};
+
+} // namespace asio_test
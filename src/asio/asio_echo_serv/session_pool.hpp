@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <utility>
+#include <boost/noncopyable.hpp>
+
+namespace asio_test {
+
+//
+// A free list of the stopped sessions, one pool per io_service.
+//
+// A session is bound to the io_service of its socket, so it can only be recycled by
+// the pool of the same io_service. The recycled session keeps its buffers, it won't be
+// reallocated or zeroed again, the type T must provide a reset() method to clear its state.
+// The receive buffers of the sessions are pooled in the same way, they are only held
+// while the sessions have data in flight (see session_buffer and http_ring_buffer).
+//
+// acquire() is called by the acceptor thread and release() is called by the thread of
+// the session, they are only different in the single acceptor mode, so the lock is
+// almost uncontended.
+//
+template <typename T>
+class session_pool : private boost::noncopyable {
+private:
+    std::mutex              lock_;
+    std::vector<T *>        free_list_;
+    std::size_t             max_size_;
+
+    std::atomic<uint64_t>   hits_;
+    std::atomic<uint64_t>   misses_;
+
+public:
+    explicit session_pool(std::size_t max_size)
+        : max_size_(max_size), hits_(0), misses_(0)
+    {
+        free_list_.reserve(max_size);
+    }
+
+    ~session_pool()
+    {
+        clear();
+    }
+
+    /// Get a recycled session, or create a new one if the pool is empty.
+    template <typename ...Args>
+    T * acquire(Args && ...args)
+    {
+        T * session = nullptr;
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            if (!free_list_.empty()) {
+                session = free_list_.back();
+                free_list_.pop_back();
+            }
+        }
+        if (session != nullptr) {
+            hits_.fetch_add(1, std::memory_order_relaxed);
+        }
+        else {
+            misses_.fetch_add(1, std::memory_order_relaxed);
+            session = new T(std::forward<Args>(args)...);
+        }
+        return session;
+    }
+
+    /// Give back a stopped session, it will be deleted if the pool is full.
+    void release(T * session)
+    {
+        session->reset();
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            if (free_list_.size() < max_size_) {
+                free_list_.push_back(session);
+                return;
+            }
+        }
+        delete session;
+    }
+
+    void clear()
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        for (std::size_t i = 0; i < free_list_.size(); ++i) {
+            delete free_list_[i];
+        }
+        free_list_.clear();
+    }
+
+    std::size_t size()
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        return free_list_.size();
+    }
+
+    std::size_t max_size() const { return max_size_; }
+
+    uint64_t hits() const { return hits_.load(std::memory_order_relaxed); }
+    uint64_t misses() const { return misses_.load(std::memory_order_relaxed); }
+};
+
+} // namespace asio_test
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <boost/noncopyable.hpp>
+#include <boost/asio.hpp>
+
+#include "io_service_pool.hpp"
+
+namespace asio_test {
+
+//
+// The accepted sessions waiting to be started by the thread of their io_service, one
+// queue per io_service.
+//
+// In the single acceptor mode, the acceptor thread only queues the new sessions, the
+// first session of an empty queue posts one handler to its io_service, which starts
+// all of the sessions queued until then. So a burst of new connections costs one
+// wake-up per io_service instead of one per connection, and the socket options of
+// the sessions are set by their own threads instead of the acceptor thread.
+//
+// T must provide a start() method.
+//
+template <typename T>
+class session_start_queue : private boost::noncopyable {
+private:
+    struct queue_t {
+        std::mutex          lock;
+        std::vector<T *>    sessions;
+        // The sessions being started, only used by the thread of the io_service.
+        std::vector<T *>    starting;
+    };
+
+    io_service_pool &   io_service_pool_;
+    std::vector< std::unique_ptr<queue_t> > queues_;
+
+public:
+    explicit session_start_queue(io_service_pool & pool)
+        : io_service_pool_(pool)
+    {
+        for (std::size_t i = 0; i < io_service_pool_.size(); ++i) {
+            queues_.push_back(std::unique_ptr<queue_t>(new queue_t));
+        }
+    }
+
+    ~session_start_queue() {}
+
+    /// Queue the accepted session to be started by the io_service of service_index.
+    void push(T * session, std::size_t service_index)
+    {
+        queue_t & queue = *queues_[service_index];
+        bool need_post;
+        {
+            std::lock_guard<std::mutex> guard(queue.lock);
+            need_post = queue.sessions.empty();
+            queue.sessions.push_back(session);
+        }
+        if (need_post) {
+            io_service_pool_.get_io_service(service_index).post(
+                [this, service_index]()
+                {
+                    start_sessions(service_index);
+                });
+        }
+    }
+
+    /// The sessions waiting to be started by the io_service of service_index.
+    std::size_t size(std::size_t service_index)
+    {
+        queue_t & queue = *queues_[service_index];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        return queue.sessions.size();
+    }
+
+private:
+    void start_sessions(std::size_t service_index)
+    {
+        queue_t & queue = *queues_[service_index];
+        {
+            std::lock_guard<std::mutex> guard(queue.lock);
+            queue.starting.swap(queue.sessions);
+        }
+        for (std::size_t i = 0; i < queue.starting.size(); ++i) {
+            queue.starting[i]->start();
+        }
+        queue.starting.clear();
+    }
+};
+
+} // namespace asio_test
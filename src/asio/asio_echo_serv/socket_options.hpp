@@ -0,0 +1,67 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <boost/asio/detail/socket_option.hpp>
+
+#if defined(__linux__)
+#include <errno.h>
+#include <sys/socket.h>
+#endif
+
+namespace asio_test {
+
+#if defined(SO_REUSEPORT)
+
+//
+// SO_REUSEPORT: Allow several listening sockets to bind to the same ip:port,
+// the kernel will spread the new connections among all of them.
+//
+// See: https://lwn.net/Articles/542629/
+//
+typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>   reuse_port;
+
+#define HAS_SOCKET_REUSE_PORT   1
+
+#else
+
+#define HAS_SOCKET_REUSE_PORT   0
+
+#endif // SO_REUSEPORT
+
+#if defined(SO_BUSY_POLL)
+
+//
+// SO_BUSY_POLL: The blocking recv() and poll() busy wait on the device queue of the NIC
+// for up to the value in microseconds (needs the NAPI driver, it has no effect on loopback).
+//
+// See: https://www.kernel.org/doc/html/latest/networking/napi.html
+//
+typedef boost::asio::detail::socket_option::integer<SOL_SOCKET, SO_BUSY_POLL>   busy_poll;
+
+#define HAS_SOCKET_BUSY_POLL    1
+
+#else
+
+#define HAS_SOCKET_BUSY_POLL    0
+
+#endif // SO_BUSY_POLL
+
+//
+// Whether nothing is waiting to be received by the socket: no data, no eof and no error.
+// On Linux it peeks one byte without blocking, so the eof and the errors are seen too,
+// elsewhere it falls back to available(), which can't tell the eof from no data.
+//
+inline bool is_socket_drained(boost::asio::ip::tcp::socket & socket)
+{
+#if defined(__linux__)
+    char byte;
+    ssize_t peek_bytes = ::recv(socket.native_handle(), &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return (peek_bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+#else
+    boost::system::error_code ec;
+    std::size_t available_bytes = socket.available(ec);
+    return (!ec && available_bytes == 0);
+#endif
+}
+
+} // namespace asio_test
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <boost/noncopyable.hpp>
+#include <boost/asio.hpp>
+
+#include "server_stats.hpp"
+
+using namespace boost::asio;
+
+namespace asio_test {
+
+//
+// The stats endpoint: a minimal HTTP/1.1 server on a secondary port, run by its own
+// thread, so the monitoring can scrape the statistics instead of parsing the console.
+//
+//   GET /stats          the plain text format (see server_stats::write_text())
+//   GET /stats.json     the JSON format, or /stats?format=json
+//
+// The monitor loop renders both formats once per interval by update(), a request only
+// copies the rendered body, so scraping doesn't touch the counters or the io_service
+// threads. Every response closes its connection.
+//
+class stats_server : private boost::noncopyable {
+private:
+    class stats_connection : public std::enable_shared_from_this<stats_connection>,
+                             private boost::noncopyable {
+    private:
+        // The requests are tiny, a longer one is not a scraper.
+        static const std::size_t kMaxRequestSize = 4096;
+
+        stats_server &          server_;
+        ip::tcp::socket         socket_;
+        boost::asio::streambuf  request_;
+        std::string             response_;
+
+    public:
+        stats_connection(boost::asio::io_service & io_service, stats_server & server)
+            : server_(server), socket_(io_service), request_(kMaxRequestSize)
+        {
+        }
+
+        ip::tcp::socket & socket() { return socket_; }
+
+        void start()
+        {
+            std::shared_ptr<stats_connection> self(shared_from_this());
+            boost::asio::async_read_until(socket_, request_, "\r\n\r\n",
+                [this, self](const boost::system::error_code & ec, std::size_t /* bytes_transferred */)
+                {
+                    if (!ec) {
+                        std::istream is(&request_);
+                        std::string method, target;
+                        is >> method >> target;
+                        server_.make_response(method, target, response_);
+                        do_write();
+                    }
+                    else {
+                        close();
+                    }
+                });
+        }
+
+    private:
+        void do_write()
+        {
+            std::shared_ptr<stats_connection> self(shared_from_this());
+            boost::asio::async_write(socket_, boost::asio::buffer(response_),
+                [this, self](const boost::system::error_code & /* ec */, std::size_t /* bytes_transferred */)
+                {
+                    close();
+                });
+        }
+
+        void close()
+        {
+            boost::system::error_code ec;
+            socket_.shutdown(socket_base::shutdown_both, ec);
+            socket_.close(ec);
+        }
+    };
+
+    boost::asio::io_service         io_service_;
+    ip::tcp::acceptor               acceptor_;
+    std::shared_ptr<std::thread>    thread_;
+
+    std::mutex      lock_;
+    std::string     text_;
+    std::string     json_;
+
+public:
+    stats_server() : acceptor_(io_service_)
+    {
+        text_ = "\n";
+        json_ = "{}\n";
+    }
+
+    ~stats_server()
+    {
+        stop();
+    }
+
+    /// Listen on the stats port and start the thread, return false if it can't listen.
+    bool start(const std::string & ip_addr, const std::string & port)
+    {
+        try {
+            ip::tcp::resolver resolver(io_service_);
+            ip::tcp::resolver::query query(ip_addr, port);
+            ip::tcp::endpoint endpoint = *resolver.resolve(query);
+
+            acceptor_.open(endpoint.protocol());
+            acceptor_.set_option(socket_base::reuse_address(true));
+            acceptor_.bind(endpoint);
+            acceptor_.listen();
+        }
+        catch (const boost::system::system_error & e) {
+            std::cout << "stats_server::start() - Error: (code = " << e.code().value() << ") "
+                      << e.code().message().c_str() << std::endl;
+            return false;
+        }
+
+        do_accept();
+        thread_ = std::make_shared<std::thread>([this] { io_service_.run(); });
+        return true;
+    }
+
+    void stop()
+    {
+        io_service_.stop();
+        if (thread_ && thread_->joinable())
+            thread_->join();
+        thread_.reset();
+    }
+
+    /// Render the new statistics, they are served until the next update.
+    void update(const server_stats & stats)
+    {
+        std::string text = stats.to_text();
+        std::string json = stats.to_json();
+        std::lock_guard<std::mutex> guard(lock_);
+        text_.swap(text);
+        json_.swap(json);
+    }
+
+private:
+    void do_accept()
+    {
+        std::shared_ptr<stats_connection> connection = std::make_shared<stats_connection>(io_service_, *this);
+        acceptor_.async_accept(connection->socket(),
+            [this, connection](const boost::system::error_code & ec)
+            {
+                if (!ec) {
+                    connection->start();
+                }
+                else if (ec == boost::asio::error::operation_aborted) {
+                    return;
+                }
+                do_accept();
+            });
+    }
+
+    void make_response(const std::string & method, const std::string & target, std::string & response)
+    {
+        std::string path = target.substr(0, target.find('?'));
+        bool is_json = (path == "/stats.json" || target.find("format=json") != std::string::npos);
+        bool found = (path == "/" || path == "/stats" || path == "/stats.json");
+
+        const char * status = "200 OK";
+        std::string body;
+        if (method != "GET") {
+            status = "405 Method Not Allowed";
+            body = "Method Not Allowed\n";
+        }
+        else if (!found) {
+            status = "404 Not Found";
+            body = "Not Found\n";
+        }
+        else {
+            std::lock_guard<std::mutex> guard(lock_);
+            body = (is_json ? json_ : text_);
+        }
+
+        response = "HTTP/1.1 ";
+        response += status;
+        response += "\r\nContent-Type: ";
+        response += ((found && is_json && method == "GET") ? "application/json" : "text/plain; charset=utf-8");
+        response += "\r\nContent-Length: ";
+        response += std::to_string(body.size());
+        response += "\r\nConnection: close\r\n\r\n";
+        response += body;
+    }
+};
+
+} // namespace asio_test
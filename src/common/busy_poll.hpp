@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+#include <chrono>
+#include <boost/asio/io_service.hpp>
+
+namespace asio_test {
+
+//
+// Run an io_service in the spin-then-park mode: poll() the ready handlers without blocking
+// until none has been ready for spin_us microseconds, then park in run_one() (which blocks
+// in epoll_wait) until the next handler, and spin again.
+//
+// While spinning, a completion is picked up by the next poll() instead of waiting for the
+// thread to be woken up, at the cost of one busy cpu per io_service thread.
+//
+// spin_us = 0 is the normal run(). Return the count of the handlers executed.
+//
+inline std::size_t run_spin_then_park(boost::asio::io_service & io_service, uint32_t spin_us)
+{
+    if (spin_us == 0)
+        return io_service.run();
+
+    typedef std::chrono::steady_clock clock_type;
+    const clock_type::duration spin_time = std::chrono::microseconds(spin_us);
+
+    std::size_t handler_count = 0;
+    while (!io_service.stopped()) {
+        clock_type::time_point idle_since = clock_type::now();
+        do {
+            std::size_t ready_count = io_service.poll();
+            if (ready_count > 0) {
+                handler_count += ready_count;
+                idle_since = clock_type::now();
+            }
+            if (io_service.stopped())
+                return handler_count;
+        } while ((clock_type::now() - idle_since) < spin_time);
+
+        handler_count += io_service.run_one();
+    }
+    return handler_count;
+}
+
+} // namespace asio_test
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+namespace asio_test {
+
+enum echo_protocol_t {
+    protocol_raw,
+    protocol_framed
+};
+
+//
+// The length-prefixed frame of the framed echo protocol:
+//
+//   +---------------+-------------+--------------+-----------------------+
+//   |  length (4)   |  type (2)   |  flags (2)   |  payload (length)     |
+//   +---------------+-------------+--------------+-----------------------+
+//
+// The header fields are little-endian, the length doesn't include the header.
+// The server echoes the frames of frame_type_echo unchanged and only consumes
+// the frames of frame_type_oneway.
+//
+struct echo_frame_header {
+    uint32_t length;
+    uint16_t type;
+    uint16_t flags;
+};
+
+class echo_frame {
+public:
+    static const uint32_t kHeaderSize = 8;
+
+    enum frame_type_t {
+        frame_type_echo = 1,
+        frame_type_oneway = 2
+    };
+
+    static void write_header(char * frame, uint32_t payload_length, uint16_t type, uint16_t flags = 0)
+    {
+        uint8_t * header = (uint8_t *)frame;
+        header[0] = (uint8_t)(payload_length);
+        header[1] = (uint8_t)(payload_length >> 8);
+        header[2] = (uint8_t)(payload_length >> 16);
+        header[3] = (uint8_t)(payload_length >> 24);
+        header[4] = (uint8_t)(type);
+        header[5] = (uint8_t)(type >> 8);
+        header[6] = (uint8_t)(flags);
+        header[7] = (uint8_t)(flags >> 8);
+    }
+
+    static void read_header(const char * frame, echo_frame_header & header)
+    {
+        const uint8_t * data = (const uint8_t *)frame;
+        header.length = (uint32_t)data[0] | ((uint32_t)data[1] << 8)
+                      | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+        header.type   = (uint16_t)(data[4] | (data[5] << 8));
+        header.flags  = (uint16_t)(data[6] | (data[7] << 8));
+    }
+
+    //
+    // Parse the complete frames at the front of the data, call handler(frame, frame_size, header)
+    // for each one, consumed returns the total size of them. The incomplete frame at the end
+    // is left for the next call, with the data which follows it.
+    //
+    // Return the number of the frames, or -1 if a frame is larger than max_frame_size
+    // (including the header) or its type is unknown.
+    //
+    template <typename Handler>
+    static int parse(const char * data, uint32_t size, uint32_t max_frame_size,
+                     uint32_t & consumed, Handler && handler)
+    {
+        int frame_count = 0;
+        consumed = 0;
+        while ((size - consumed) >= kHeaderSize) {
+            echo_frame_header header;
+            read_header(data + consumed, header);
+            if (header.length > max_frame_size - kHeaderSize)
+                return -1;
+            if (header.type != frame_type_echo && header.type != frame_type_oneway)
+                return -1;
+
+            uint32_t frame_size = kHeaderSize + header.length;
+            if ((size - consumed) < frame_size)
+                break;
+
+            handler(data + consumed, frame_size, header);
+            consumed += frame_size;
+            frame_count++;
+        }
+        return frame_count;
+    }
+};
+
+} // namespace asio_test
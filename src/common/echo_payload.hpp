@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+namespace asio_test {
+
+//
+// The optional header at the front of an echo packet, the echo server returns it
+// unchanged, so the client can match every response to its request:
+//
+//   magic      : kMagic, marks the beginning of a packet.
+//   checksum   : FNV-1a of the body (the bytes after the header), then of the
+//                header with the checksum field as 0.
+//   sequence   : the request number of the connection, from 0.
+//   timestamp  : the (intended) send time of the request, in nanoseconds.
+//   conn_id    : the connection number of the client.
+//   length     : the packet size, including the header.
+//
+// The fields are in the host byte order, the client checks its own packets.
+//
+struct echo_payload_header {
+    uint32_t magic;
+    uint32_t checksum;
+    uint64_t sequence;
+    uint64_t timestamp;
+    uint32_t conn_id;
+    uint32_t length;
+};
+
+class echo_payload {
+public:
+    static const uint32_t kMagic = 0x4F495341UL;     // "ASIO"
+    static const uint32_t kHeaderSize = sizeof(echo_payload_header);
+
+    enum verify_result_t {
+        verify_ok,
+        verify_bad_magic,
+        verify_bad_length,
+        verify_bad_checksum
+    };
+
+    static uint32_t fnv1a(const char * data, std::size_t size, uint32_t hash = 2166136261UL)
+    {
+        for (std::size_t i = 0; i < size; ++i) {
+            hash ^= (uint8_t)data[i];
+            hash *= 16777619UL;
+        }
+        return hash;
+    }
+
+    /// The checksum of the body, the same for every packet of a connection.
+    static uint32_t body_checksum(const char * packet, uint32_t packet_size)
+    {
+        return fnv1a(packet + kHeaderSize, packet_size - kHeaderSize);
+    }
+
+    /// Write the header in front of the packet, the body must be filled already.
+    static void write_header(char * packet, uint32_t packet_size, uint32_t body_hash,
+                             uint64_t sequence, uint64_t timestamp, uint32_t conn_id)
+    {
+        echo_payload_header header;
+        header.magic = kMagic;
+        header.checksum = 0;
+        header.sequence = sequence;
+        header.timestamp = timestamp;
+        header.conn_id = conn_id;
+        header.length = packet_size;
+        header.checksum = fnv1a((const char *)&header, sizeof(header), body_hash);
+        ::memcpy(packet, &header, sizeof(header));
+    }
+
+    /// Verify the whole packet and read the header.
+    static verify_result_t read_header(const char * packet, uint32_t packet_size,
+                                       echo_payload_header & header)
+    {
+        ::memcpy(&header, packet, sizeof(header));
+        if (header.magic != kMagic)
+            return verify_bad_magic;
+        if (header.length != packet_size)
+            return verify_bad_length;
+
+        uint32_t checksum = header.checksum;
+        header.checksum = 0;
+        uint32_t hash = fnv1a((const char *)&header, sizeof(header), body_checksum(packet, packet_size));
+        header.checksum = checksum;
+        return ((hash == checksum) ? verify_ok : verify_bad_checksum);
+    }
+};
+
+} // namespace asio_test
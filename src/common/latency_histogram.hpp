@@ -0,0 +1,231 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+namespace asio_test {
+
+//
+// A HDR (High Dynamic Range) style histogram, the values are recorded into
+// log-linear buckets: every power of two range is split into kSubBucketHalf
+// linear sub-buckets, so the relative error of any value is less than
+// 1 / kSubBucketHalf (0.78%), the memory is fixed and record() is O(1).
+//
+// The values are in nanoseconds, the values larger than kMaxValue are clamped,
+// but the max_value() is always exact.
+//
+// It's not thread safe, use one histogram per thread and merge() them.
+//
+// See: http://hdrhistogram.org/
+//
+class latency_histogram {
+public:
+    enum {
+        kSubBucketBits  = 8,
+        kSubBucketCount = 1 << kSubBucketBits,
+        kSubBucketHalf  = kSubBucketCount / 2,
+        kMaxValueBits   = 40,
+        // The buckets of the values in [0, 2^kMaxValueBits).
+        kBucketCount    = (kMaxValueBits - kSubBucketBits + 2) * kSubBucketHalf
+    };
+
+    static const uint64_t kMaxValue = (1ULL << kMaxValueBits) - 1;
+
+private:
+    std::vector<uint64_t> counts_;
+    uint64_t total_count_;
+    uint64_t min_;
+    uint64_t max_;
+    // For mean(), may overflow only after 2^64 ns in total (584 years).
+    uint64_t sum_;
+
+public:
+    latency_histogram()
+        : counts_(kBucketCount, 0), total_count_(0), min_(std::numeric_limits<uint64_t>::max()), max_(0), sum_(0)
+    {
+    }
+
+    ~latency_histogram() {}
+
+    void reset()
+    {
+        std::fill(counts_.begin(), counts_.end(), 0);
+        total_count_ = 0;
+        min_ = std::numeric_limits<uint64_t>::max();
+        max_ = 0;
+        sum_ = 0;
+    }
+
+    void record(uint64_t value, uint64_t count = 1)
+    {
+        counts_[get_bucket_index(value)] += count;
+        total_count_ += count;
+        sum_ += value * count;
+        if (value < min_)
+            min_ = value;
+        if (value > max_)
+            max_ = value;
+    }
+
+    void merge(const latency_histogram & other)
+    {
+        for (std::size_t i = 0; i < kBucketCount; ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        total_count_ += other.total_count_;
+        sum_ += other.sum_;
+        if (other.min_ < min_)
+            min_ = other.min_;
+        if (other.max_ > max_)
+            max_ = other.max_;
+    }
+
+    uint64_t count() const { return total_count_; }
+    uint64_t min_value() const { return (total_count_ != 0) ? min_ : 0; }
+    uint64_t max_value() const { return max_; }
+
+    double mean() const
+    {
+        return (total_count_ != 0) ? ((double)sum_ / (double)total_count_) : 0.0;
+    }
+
+    /// The highest value of the bucket which the percentile (0.0 ~ 100.0) falls in.
+    uint64_t value_at_percentile(double percentile) const
+    {
+        if (total_count_ == 0)
+            return 0;
+        if (percentile > 100.0)
+            percentile = 100.0;
+        uint64_t target = (uint64_t)((percentile / 100.0) * (double)total_count_ + 0.5);
+        if (target < 1)
+            target = 1;
+        uint64_t cumulative = 0;
+        for (std::size_t i = 0; i < kBucketCount; ++i) {
+            cumulative += counts_[i];
+            if (cumulative >= target) {
+                uint64_t value = get_bucket_highest_value(i);
+                return (value < max_) ? value : max_;
+            }
+        }
+        return max_;
+    }
+
+    //
+    // Export the percentile distribution in the text format of HdrHistogram's
+    // outputPercentileDistribution(), the columns are: value, percentile, total count
+    // and 1 / (1 - percentile), the values are divided by value_scale (for example,
+    // 1000.0 to output in microseconds).
+    //
+    void export_percentiles(std::ostream & os, double value_scale = 1000.0,
+                            uint32_t ticks_per_half_distance = 5) const
+    {
+        os << std::setw(12) << "Value" << " " << std::setw(14) << "Percentile" << " "
+           << std::setw(10) << "TotalCount" << " " << std::setw(14) << "1/(1-Percentile)"
+           << std::endl << std::endl;
+
+        os << std::setiosflags(std::ios::fixed);
+        if (total_count_ != 0) {
+            double percentile = 0.0;
+            double reporting_level = 0.0;
+            uint64_t cumulative = 0;
+            std::size_t index = 0, last_index = kBucketCount;
+            while (index < kBucketCount) {
+                // Find the bucket of the next reporting level.
+                uint64_t target = (uint64_t)((reporting_level / 100.0) * (double)total_count_ + 0.5);
+                if (target < 1)
+                    target = 1;
+                while (index < kBucketCount && (cumulative + counts_[index]) < target) {
+                    cumulative += counts_[index];
+                    index++;
+                }
+                if (index >= kBucketCount)
+                    break;
+
+                uint64_t value = get_bucket_highest_value(index);
+                if (value > max_)
+                    value = max_;
+                percentile = (double)(cumulative + counts_[index]) / (double)total_count_;
+                if (index == last_index && percentile < 1.0) {
+                    // The reporting level is still in the last bucket.
+                    reporting_level += 100.0 * (1.0 - percentile) / (double)ticks_per_half_distance;
+                    continue;
+                }
+                last_index = index;
+                os << std::setw(12) << std::setprecision(3) << ((double)value / value_scale) << " "
+                   << std::setw(14) << std::setprecision(12) << percentile << " "
+                   << std::setw(10) << (cumulative + counts_[index]) << " ";
+                if (percentile < 1.0)
+                    os << std::setw(14) << std::setprecision(2) << (1.0 / (1.0 - percentile));
+                os << std::endl;
+                if (percentile >= 1.0)
+                    break;
+
+                // Halve the distance to 100% every ticks_per_half_distance lines.
+                double half_distance = 100.0;
+                while ((100.0 - reporting_level) < half_distance && half_distance > 1e-9) {
+                    half_distance /= 2.0;
+                }
+                reporting_level += half_distance / (double)ticks_per_half_distance;
+                if (percentile * 100.0 > reporting_level)
+                    reporting_level = percentile * 100.0;
+            }
+        }
+
+        os << std::setprecision(3)
+           << "#[Mean    = " << std::setw(12) << (mean() / value_scale)
+           << ", Max        = " << std::setw(12) << ((double)max_ / value_scale) << "]" << std::endl
+           << "#[Min     = " << std::setw(12) << ((double)min_value() / value_scale)
+           << ", TotalCount = " << std::setw(12) << total_count_ << "]" << std::endl;
+        os << std::resetiosflags(std::ios::fixed);
+    }
+
+    static std::size_t get_bucket_index(uint64_t value)
+    {
+        if (value > kMaxValue)
+            value = kMaxValue;
+        if (value < kSubBucketCount)
+            return (std::size_t)value;
+        // The sub-bucket of the value is in [kSubBucketHalf, kSubBucketCount).
+        uint32_t shift = get_highest_bit(value) - (kSubBucketBits - 1);
+        std::size_t sub_bucket = (std::size_t)(value >> shift);
+        return (std::size_t)shift * kSubBucketHalf + sub_bucket;
+    }
+
+    static uint64_t get_bucket_lowest_value(std::size_t index)
+    {
+        if (index < kSubBucketCount)
+            return (uint64_t)index;
+        uint32_t shift = (uint32_t)(index / kSubBucketHalf) - 1;
+        uint64_t sub_bucket = (uint64_t)(index - shift * kSubBucketHalf);
+        return (sub_bucket << shift);
+    }
+
+    static uint64_t get_bucket_highest_value(std::size_t index)
+    {
+        if (index < kSubBucketCount)
+            return (uint64_t)index;
+        uint32_t shift = (uint32_t)(index / kSubBucketHalf) - 1;
+        uint64_t sub_bucket = (uint64_t)(index - shift * kSubBucketHalf);
+        return ((sub_bucket + 1) << shift) - 1;
+    }
+
+private:
+    static uint32_t get_highest_bit(uint64_t value)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return (uint32_t)(63 - __builtin_clzll(value));
+#else
+        uint32_t bit = 0;
+        while (value >>= 1)
+            bit++;
+        return bit;
+#endif
+    }
+};
+
+} // namespace asio_test
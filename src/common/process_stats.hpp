@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
+namespace asio_test {
+
+//
+// The resource usage of the current process, for sizing the servers which hold a lot
+// of connections. Only Linux is supported, the other platforms return 0.
+//
+class process_stats {
+public:
+    /// The resident memory (RSS) in bytes, read from /proc/self/statm.
+    static uint64_t resident_memory()
+    {
+#if defined(__linux__)
+        FILE * fp = ::fopen("/proc/self/statm", "r");
+        if (fp == nullptr)
+            return 0;
+        unsigned long total_pages = 0, resident_pages = 0;
+        int fields = ::fscanf(fp, "%lu %lu", &total_pages, &resident_pages);
+        ::fclose(fp);
+        if (fields != 2)
+            return 0;
+        return (uint64_t)resident_pages * (uint64_t)::sysconf(_SC_PAGESIZE);
+#else
+        return 0;
+#endif
+    }
+
+    /// The id of the current thread in the kernel (gettid), for the per thread statistics.
+    static int current_thread_id()
+    {
+#if defined(__linux__)
+        return (int)::syscall(SYS_gettid);
+#else
+        return 0;
+#endif
+    }
+
+    /// The cpu time (user + system) of a thread of this process in nanoseconds,
+    /// read from /proc/self/task/<thread_id>/stat.
+    static uint64_t thread_cpu_time(int thread_id)
+    {
+#if defined(__linux__)
+        if (thread_id <= 0)
+            return 0;
+        char filename[64];
+        ::snprintf(filename, sizeof(filename), "/proc/self/task/%d/stat", thread_id);
+        FILE * fp = ::fopen(filename, "r");
+        if (fp == nullptr)
+            return 0;
+        char line[1024];
+        char * result = ::fgets(line, sizeof(line), fp);
+        ::fclose(fp);
+        if (result == nullptr)
+            return 0;
+
+        // The thread name (field 2) may contain spaces, the fields are counted after its ')'.
+        char * fields = ::strrchr(line, ')');
+        if (fields == nullptr)
+            return 0;
+        unsigned long long user_ticks = 0, system_ticks = 0;
+        if (::sscanf(fields + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+                     &user_ticks, &system_ticks) != 2)
+            return 0;
+        long ticks_per_second = ::sysconf(_SC_CLK_TCK);
+        if (ticks_per_second <= 0)
+            return 0;
+        return (uint64_t)((user_ticks + system_ticks) * (1000000000ULL / (unsigned long long)ticks_per_second));
+#else
+        (void)thread_id;
+        return 0;
+#endif
+    }
+
+    /// Raise the soft limit of the open files (RLIMIT_NOFILE) to the hard limit,
+    /// every connection needs a file descriptor. Return the new soft limit.
+    static uint64_t raise_open_files_limit()
+    {
+#if defined(__linux__)
+        struct rlimit limit;
+        if (::getrlimit(RLIMIT_NOFILE, &limit) != 0)
+            return 0;
+        if (limit.rlim_cur < limit.rlim_max) {
+            struct rlimit new_limit = limit;
+            new_limit.rlim_cur = limit.rlim_max;
+            if (::setrlimit(RLIMIT_NOFILE, &new_limit) == 0)
+                limit = new_limit;
+        }
+        return (uint64_t)limit.rlim_cur;
+#else
+        return 0;
+#endif
+    }
+};
+
+} // namespace asio_test
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <boost/noncopyable.hpp>
+
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE  64
+#endif
+
+namespace asio_test {
+
+////////////////////////////////////////////////////////////////////////////////////////
+
+//
+// Give every thread a small index the first time it touches a sharded counter,
+// all of the sharded counters use the same index for the same thread.
+//
+class thread_slot_registry {
+public:
+    static std::size_t index()
+    {
+        static thread_local std::size_t slot_index = next_index().fetch_add(1, std::memory_order_relaxed);
+        return slot_index;
+    }
+
+private:
+    static std::atomic<std::size_t> & next_index()
+    {
+        static std::atomic<std::size_t> next_index_(0);
+        return next_index_;
+    }
+};
+
+////////////////////////////////////////////////////////////////////////////////////////
+
+//
+// A counter split into one cache line per thread, the owner thread updates its own
+// slot with a relaxed load and store (no lock prefix), and the reader sums all slots.
+// The sum is exact except for the updates which are still in flight.
+//
+// The threads after the first (kMaxSlots - 1) share the last slot with fetch_add().
+//
+class sharded_counter : private boost::noncopyable {
+public:
+    enum { kMaxSlots = 128 };
+
+private:
+    struct alignas(CACHE_LINE_SIZE) slot_t {
+        std::atomic<uint64_t> value;
+        char padding[CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+    };
+
+    slot_t slots_[kMaxSlots];
+
+public:
+    sharded_counter()
+    {
+        for (std::size_t i = 0; i < kMaxSlots; ++i) {
+            slots_[i].value.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    ~sharded_counter() {}
+
+    void add(uint64_t delta)
+    {
+        std::size_t index = thread_slot_registry::index();
+        if (index < (kMaxSlots - 1)) {
+            std::atomic<uint64_t> & value = slots_[index].value;
+            value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+        }
+        else {
+            slots_[kMaxSlots - 1].value.fetch_add(delta, std::memory_order_relaxed);
+        }
+    }
+
+    uint64_t load() const
+    {
+        uint64_t sum = 0;
+        for (std::size_t i = 0; i < kMaxSlots; ++i) {
+            sum += slots_[i].value.load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    operator uint64_t() const
+    {
+        return load();
+    }
+};
+
+} // namespace asio_test
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdint.h>
+#include <mutex>
+#include <atomic>
+#include <boost/noncopyable.hpp>
+
+#include "common/padding_atomic.hpp"
+#include "common/sharded_counter.hpp"
+#include "common/latency_histogram.hpp"
+
+namespace asio_test {
+
+//
+// A latency histogram split into one slot per thread. The slot of a thread is allocated
+// the first time it records, the lock of a slot is only contended once per report
+// interval, when the reporter collects it.
+//
+// record() picks the slot of the current thread, for the io_service threads which have
+// no index of their own, record_at() takes the index of the caller's thread instead.
+// The threads after the first (kMaxSlots - 1) share the last slot.
+//
+class sharded_histogram : private boost::noncopyable {
+public:
+    enum { kMaxSlots = 64 };
+
+private:
+    // The slots are allocated one by one, the paddings keep the locks of the
+    // neighbour slots out of the same cache line (no aligned new in C++11).
+    struct slot_t {
+        char                padding1[CACHE_LINE_SIZE];
+        std::mutex          lock;
+        latency_histogram   histogram;
+        char                padding2[CACHE_LINE_SIZE];
+    };
+
+    std::atomic<slot_t *> slots_[kMaxSlots];
+
+public:
+    sharded_histogram()
+    {
+        for (std::size_t i = 0; i < kMaxSlots; ++i) {
+            slots_[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    ~sharded_histogram()
+    {
+        for (std::size_t i = 0; i < kMaxSlots; ++i) {
+            delete slots_[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    /// Record a latency (in nanoseconds) into the slot of the current thread.
+    void record(uint64_t value, uint64_t count = 1)
+    {
+        record_at(thread_slot_registry::index(), value, count);
+    }
+
+    /// Record a latency (in nanoseconds) into the slot of the thread index.
+    void record_at(std::size_t index, uint64_t value, uint64_t count = 1)
+    {
+        slot_t & slot = get_slot(index);
+        std::lock_guard<std::mutex> guard(slot.lock);
+        slot.histogram.record(value, count);
+    }
+
+    /// Move the latencies recorded since the last call into the interval histogram.
+    void collect(latency_histogram & interval)
+    {
+        interval.reset();
+        for (std::size_t i = 0; i < kMaxSlots; ++i) {
+            slot_t * slot = slots_[i].load(std::memory_order_acquire);
+            if (slot != nullptr) {
+                std::lock_guard<std::mutex> guard(slot->lock);
+                interval.merge(slot->histogram);
+                slot->histogram.reset();
+            }
+        }
+    }
+
+private:
+    slot_t & get_slot(std::size_t index)
+    {
+        if (index >= kMaxSlots)
+            index = kMaxSlots - 1;
+        slot_t * slot = slots_[index].load(std::memory_order_acquire);
+        if (slot == nullptr) {
+            slot_t * new_slot = new slot_t;
+            if (slots_[index].compare_exchange_strong(slot, new_slot, std::memory_order_acq_rel))
+                slot = new_slot;
+            else
+                delete new_slot;
+        }
+        return *slot;
+    }
+};
+
+} // namespace asio_test